@@ -0,0 +1,111 @@
+// Alias analysis.
+//
+// Addresses are told apart by the object they point into: a local, a
+// global, or unknown for a pointer from elsewhere. Distinct objects
+// don't overlap, and a pointer from elsewhere can't point into a local
+// whose address is only used to compute addresses to load and store:
+// such a local can't be reached through other pointers or by calls.
+#include <string.h>
+#include "alias.h"
+#include "mem.h"
+
+static void setBase(AliasInfo *ai, int r, int base, void *obj) {
+    ai->Base[r] = base;
+    ai->Obj[r] = obj;
+}
+
+// Finds what the registers point into. Definitions come before uses
+// in reverse postorder, except for block parameters, which are
+// unknown, as are registers not in SSA form.
+static void findBases(AliasInfo *ai, DefUse *du) {
+    Function *fn = ai->fn;
+    for (int i = 0; i < fn->RPO.len; i++) {
+        BB *bb = BBVecGet(&fn->RPO, i);
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            int r0 = ir->r0;
+            if (!r0 || du->Def[r0] == DEF_MANY) continue;
+            switch (ir->ty) {
+            case IR_BPREL:
+                setBase(ai, r0, BASE_LOCAL, ir->ID);
+                break;
+            case IR_LABEL_ADDR:
+                setBase(ai, r0, BASE_GLOBAL, ir->Name);
+                break;
+            case IR_MOV:
+                setBase(ai, r0, ai->Base[ir->r2], ai->Obj[ir->r2]);
+                break;
+            case IR_ADD:
+                // Pointer plus integer.
+                if (!ai->Base[ir->r2]) setBase(ai, r0, ai->Base[ir->r1], ai->Obj[ir->r1]);
+                else if (!ai->Base[ir->r1]) setBase(ai, r0, ai->Base[ir->r2], ai->Obj[ir->r2]);
+                break;
+            case IR_SUB:
+                if (!ai->Base[ir->r2]) setBase(ai, r0, ai->Base[ir->r1], ai->Obj[ir->r1]);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+static void findEscapes(AliasInfo *ai, DefUse *du) {
+    Function *fn = ai->fn;
+    IntVec uses = {0};
+    for (int i = 0; i < fn->RPO.len; i++) {
+        BB *bb = BBVecGet(&fn->RPO, i);
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            // A register set more than once points into unknown
+            // objects.
+            if (ir->ty == IR_BPREL && du->Def[ir->r0] == DEF_MANY) {
+                ai->Escapes[LocalIndex(fn, ir->ID)] = 1;
+            }
+            IRUses(fn, ir, &uses);
+            for (int i = 0; i < uses.len; i++) {
+                int r = IntVecGet(&uses, i);
+                if (ai->Base[r] != BASE_LOCAL) continue;
+                if (ir->ty == IR_LOAD) continue;
+                if (ir->ty == IR_STORE && r != ir->r2) continue;
+                if ((ir->ty == IR_ADD || ir->ty == IR_SUB || ir->ty == IR_MOV) &&
+                    ai->Base[ir->r0] == BASE_LOCAL && ai->Obj[ir->r0] == ai->Obj[r]) {
+                    continue;
+                }
+                ai->Escapes[LocalIndex(fn, ai->Obj[r])] = 1;
+            }
+        }
+    }
+    IntVecFree(&uses);
+}
+
+// Analyzes the reachable blocks of fn, whose CFG must be up to date.
+AliasInfo *NewAliasInfo(Function *fn, DefUse *du) {
+    AliasInfo *ai = MemCalloc(MEM_OTHER, 1, sizeof(AliasInfo));
+    ai->fn = fn;
+    ai->Base = MemCalloc(MEM_OTHER, fn->NRegs + 1, 1);
+    ai->Obj = MemCalloc(MEM_OTHER, fn->NRegs + 1, sizeof(void *));
+    ai->Escapes = MemCalloc(MEM_OTHER, VectorSize(fn->LocalVars) + 1, 1);
+    findBases(ai, du);
+    findEscapes(ai, du);
+    return ai;
+}
+
+void FreeAliasInfo(AliasInfo *ai) {
+    MemFree(ai->Base);
+    MemFree(ai->Obj);
+    MemFree(ai->Escapes);
+    MemFree(ai);
+}
+
+// Returns whether pointers from elsewhere may point into the object.
+int MayEscape(AliasInfo *ai, int base, void *obj) {
+    return base != BASE_LOCAL || ai->Escapes[LocalIndex(ai->fn, obj)];
+}
+
+// Returns whether addresses into the objects may be the same.
+int MayAlias(AliasInfo *ai, int base1, void *obj1, int base2, void *obj2) {
+    if (!base1 || !base2) return MayEscape(ai, base1, obj1) && MayEscape(ai, base2, obj2);
+    if (base1 != base2) return 0;
+    return base1 == BASE_LOCAL ? obj1 == obj2 : !strcmp(obj1, obj2);
+}
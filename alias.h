@@ -0,0 +1,29 @@
+#ifndef ALIAS_H
+#define ALIAS_H
+
+#include "ir.h"
+
+// The kinds of objects an address can point into.
+enum {
+    BASE_UNKNOWN, // a pointer from elsewhere
+    BASE_LOCAL,
+    BASE_GLOBAL,
+};
+
+// What the registers of a function point into, found from how they
+// are computed, which stays valid as long as no instruction is
+// changed to compute an address differently.
+typedef struct AliasInfo {
+    Function *fn;
+    char *Base;    // per register: BASE_*
+    void **Obj;    // per register: the Var of a local, the name of a global
+    char *Escapes; // per local: whether its address is used otherwise than
+                   // to compute addresses to load and store
+} AliasInfo;
+
+AliasInfo *NewAliasInfo(Function *fn, DefUse *du);
+void FreeAliasInfo(AliasInfo *ai);
+int MayEscape(AliasInfo *ai, int base, void *obj);
+int MayAlias(AliasInfo *ai, int base1, void *obj1, int base2, void *obj2);
+
+#endif
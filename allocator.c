@@ -9,105 +9,205 @@
 // some register R, if all physical registers are already allocated,
 // one of them (including R itself) needs to be spilled to the stack.
 // As long as one register is spilled, the algorithm is logically
-// correct. As a heuristic, we spill a register whose last use is
-// furthest.
+// correct. As a heuristic, we spill the register that is cheapest to
+// keep in memory for the rest of its range: each definition and use
+// costs 8 to the power of the loop depth, and the cost is divided by
+// how far away the last use is.
+//
+// Registers a move copies between are allocated to the same register
+// when the ranges allow, which makes the move a no-op: each prefers
+// the register of the other if that is free at its definition. As the
+// conversion to two-address form copies the first operand to the
+// result, commutative operations read the operand dying there first.
 //
 // We then insert load and store instructions for spilled registesr.
 // The last register (num_regs-1'th register) is reserved for that
-// purpose.
+// purpose. An instruction that reads two spilled registers gets the
+// second one in a spare register past the allocatable ones.
 
 #include "allocator.h"
+#include "cfg.h"
+#include "mem.h"
+#include "pass.h"
+#include "remark.h"
+#include "stats.h"
+#include "timer.h"
 #include <assert.h>
 #include <stdlib.h>
 
-// Rewrite `A = B op C` to `A = B; A = A ty C`.
-void optimizeAssign(BB *bb) {
-    Vector *v = NewVector();
+static int isCommutative(IRType ty) {
+    return ty == IR_ADD || ty == IR_MUL || ty == IR_AND || ty == IR_OR ||
+           ty == IR_XOR || ty == IR_EQ || ty == IR_NE;
+}
+
+// Swaps the operands of the commutative operations of bb whose first
+// operand is still live after them but whose second is not, so that
+// the result can take the register of the second. live has a zero
+// per register on entry and on return.
+void swapOperands(Function *fn, BB *bb, char *live) {
+    IntVec uses = {0};
+    for (int i = BitSetNext(bb->OutRegs, 0); i >= 0; i = BitSetNext(bb->OutRegs, i + 1)) {
+        live[IntVecGet(&fn->LiveRegs, i)] = 1;
+    }
+
+    for (int i = bb->IRs.len - 1; i >= 0; i--) {
+        IR *ir = IRVecData(&bb->IRs) + i;
+        if (ir->r0 && isCommutative(ir->ty) && live[ir->r1] && !live[ir->r2]) {
+            int r = ir->r1;
+            ir->r1 = ir->r2;
+            ir->r2 = r;
+        }
+        if (ir->r0) live[ir->r0] = 0;
+        IRUses(fn, ir, &uses);
+        for (int i = 0; i < uses.len; i++) live[IntVecGet(&uses, i)] = 1;
+    }
 
-    for (int i = 0; i < VectorSize(bb->IRs); i++) {
-        IR *ir = VectorGet(bb->IRs, i);
+    for (int i = 0; i < bb->IRs.len; i++) {
+        IRUses(fn, IRVecData(&bb->IRs) + i, &uses);
+        for (int i = 0; i < uses.len; i++) live[IntVecGet(&uses, i)] = 0;
+    }
+    for (int i = BitSetNext(bb->OutRegs, 0); i >= 0; i = BitSetNext(bb->OutRegs, i + 1)) {
+        live[IntVecGet(&fn->LiveRegs, i)] = 0;
+    }
+    IntVecFree(&uses);
+}
 
+// Rewrite `A = B op C` to `A = B; A = A ty C`.
+void optimizeAssign(BB *bb) {
+    IRCursor c;
+    for (IROpen(&c, bb); IRCur(&c); IRNext(&c)) {
+        IR *ir = IRCur(&c);
         if (!ir->r0 || !ir->r1) {
-            VectorPush(v, ir);
             continue;
         }
 
         assert(ir->r0 != ir->r1);
 
-        IR *ir2 = calloc(1, sizeof(IR));
-        ir2->ty = IR_MOV;
-        ir2->r0 = ir->r0;
-        ir2->r2 = ir->r1;
-        VectorPush(v, ir2);
-
+        IR mov = {.ty = IR_MOV, .r0 = ir->r0, .r2 = ir->r1};
         ir->r1 = ir->r0;
-        VectorPush(v, ir);
+        IRInsertBefore(&c, mov);
     }
-    bb->IRs = v;
+    IRClose(&c);
 }
 
-void setLastUse(Reg *r, int ic) {
-    if (r && r->LastUse < ic) {
-        r->LastUse = ic;
+void setLastUse(Function *fn, int r, int ic) {
+    Reg *reg = GetReg(fn, r);
+    if (r && reg->LastUse < ic) {
+        reg->LastUse = ic;
     }
 }
 
-Vector *collectRegs(Function *fn) {
-    Vector *v = NewVector();
+// Makes the registers of a move prefer each other's register.
+void setHints(Function *fn, IR *ir) {
+    if (ir->ty != IR_MOV) return;
+    if (!GetReg(fn, ir->r0)->Hint) GetReg(fn, ir->r0)->Hint = ir->r2;
+    if (!GetReg(fn, ir->r2)->Hint) GetReg(fn, ir->r2)->Hint = ir->r0;
+}
+
+void setDef(Function *fn, IntVec *v, int r, int ic) {
+    if (!GetReg(fn, r)->Def) {
+        GetReg(fn, r)->Def = ic;
+        IntVecPush(v, r);
+    }
+}
+
+// Returns the numbers of the registers in order of definition. If
+// lines is not NULL, it gets the source line of each instruction by
+// instruction counter.
+//
+// A register is given the single range from the first to the last
+// instruction where it is live. Registers can be defined in several
+// blocks and live into blocks laid out before their definitions, so
+// the range also covers the blocks it is live into.
+IntVec collectRegs(Function *fn, IntVec *lines) {
+    IntVec v = {0};
+    IntVec uses = {0};
     int ic = 1; // instruction counter
+    if (lines) IntVecPush(lines, 0);
 
-    for (int i = 0; i < VectorSize(fn->bbs); i++) {
-        BB *bb = VectorGet(fn->bbs, i);
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
 
-        if (bb->Param) {
-            bb->Param->Def = ic;
-            VectorPush(v, bb->Param);
+        for (int i = BitSetNext(bb->InRegs, 0); i >= 0; i = BitSetNext(bb->InRegs, i + 1)) {
+            setDef(fn, &v, IntVecGet(&fn->LiveRegs, i), ic);
         }
 
-        for (int i = 0; i < VectorSize(bb->IRs); i++, ic++) {
-            IR *ir = VectorGet(bb->IRs, i);
+        int weight = 1;
+        for (int i = LoopDepth(bb); i > 0 && weight < 1 << 24; i--) weight *= 8;
 
-            if (ir->r0 && !ir->r0->Def) {
-                ir->r0->Def = ic;
-                VectorPush(v, ir->r0);
-            }
+        for (int i = 0; i < bb->IRs.len; i++, ic++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            if (lines) IntVecPush(lines, ir->Line);
+            setHints(fn, ir);
 
-            setLastUse(ir->r1, ic);
-            setLastUse(ir->r2, ic);
-            setLastUse(ir->bbArg, ic);
+            if (ir->r0) {
+                setDef(fn, &v, ir->r0, ic);
+                GetReg(fn, ir->r0)->Cost += weight;
+            }
 
-            if (ir->ty == IR_CALL) {
-                for (int i = 0; i < ir->NArgs; i++) {
-                    setLastUse(ir->Args[i], ic);
-                }
+            IRUses(fn, ir, &uses);
+            for (int i = 0; i < uses.len; i++) {
+                setLastUse(fn, IntVecGet(&uses, i), ic);
+                GetReg(fn, IntVecGet(&uses, i))->Cost += weight;
             }
         }
 
-        for (int i = 0; i < VectorSize(bb->OutRegs); i++) {
-            Reg *r = VectorGet(bb->OutRegs, i);
-            setLastUse(r, ic);
+        for (int i = BitSetNext(bb->OutRegs, 0); i >= 0; i = BitSetNext(bb->OutRegs, i + 1)) {
+            setLastUse(fn, IntVecGet(&fn->LiveRegs, i), ic - 1);
         }
     }
 
+    IntVecFree(&uses);
     return v;
 }
 
-int chooseToSpill(Reg **used) {
+// Returns the register in used to spill at instruction ic: the one
+// with the least cost per instruction left in its range.
+int chooseToSpill(Reg **used, int ic) {
     int k = 0;
     for (int i = 1; i < num_regs; i++) {
-        if (used[k]->LastUse < used[i]->LastUse) {
+        long long a = (long long)used[i]->Cost * (used[k]->LastUse - ic + 1);
+        long long b = (long long)used[k]->Cost * (used[i]->LastUse - ic + 1);
+        if (a < b || (a == b && used[k]->LastUse < used[i]->LastUse)) {
             k = i;
         }
     }
     return k;
 }
 
-// Allocate registers.
-void scan(Vector *regs) {
-    Reg **used = calloc(num_regs, sizeof(Reg *));
+void remarkSpill(Function *fn, Reg *r, Reg *victim, IntVec *lines) {
+    int line = IntVecGet(lines, r->Def);
+    int defLine = IntVecGet(lines, victim->Def);
+    int lastLine = IntVecGet(lines, victim->LastUse);
+    Remark(REMARK_MISSED, "regalloc", line,
+           "r%d, defined at line %d, spilled to the stack: all %d registers are in use "
+           "and it is the cheapest to keep in memory until its last use, at line %d",
+           (int)(victim - GetReg(fn, 0)), defLine, num_regs - 1, lastLine);
+}
+
+// Returns the slot of the register r prefers if that is allocated
+// and free at the definition of r, or -1.
+int hintSlot(Function *fn, Reg **used, Reg *r) {
+    if (!r->Hint) return -1;
+    int k = GetReg(fn, r->Hint)->RealNum;
+    if (k < 0 || k >= num_regs - 1) return -1;
+    return !used[k] || r->Def >= used[k]->LastUse ? k : -1;
+}
 
-    for (int i = 0; i < VectorSize(regs); i++) {
-        Reg *r = VectorGet(regs, i);
+// Allocate registers. lines is as collectRegs returns it, or NULL if
+// spills need not be reported.
+void scan(Function *fn, IntVec *regs, IntVec *lines) {
+    Reg **used = MemCalloc(MEM_OTHER, num_regs, sizeof(Reg *));
+
+    for (int i = 0; i < regs->len; i++) {
+        Reg *r = GetReg(fn, IntVecGet(regs, i));
+
+        int hint = hintSlot(fn, used, r);
+        if (hint >= 0) {
+            r->RealNum = hint;
+            used[hint] = r;
+            continue;
+        }
 
         // Find an unused slot.
         int found = 0;
@@ -127,53 +227,103 @@ void scan(Vector *regs) {
 
         // Choose a register to spill and mark it as "spilled".
         used[num_regs - 1] = r;
-        int k = chooseToSpill(used);
+        int k = chooseToSpill(used, r->Def);
+        if (lines) remarkSpill(fn, r, used[k], lines);
 
         r->RealNum = k;
         used[k]->RealNum = num_regs - 1;
         used[k]->Spill = 1;
         used[k] = r;
     }
+    MemFree(used);
 }
 
-void spillStore(Vector *v, IR *ir) {
-    Reg *r = ir->r0;
-    if (!r || !r->Spill) {
-        return;
+// Returns, per register, the instruction defining it if that is its
+// only definition and cheap enough to repeat before every use instead
+// of keeping the register in a stack slot when it is spilled: an
+// immediate or an address. Other registers get an instruction with
+// r0 0. Call arguments are read from their slots, so registers passed
+// to calls always get one.
+IR *findRemat(Function *fn) {
+    IR *remat = MemCalloc(MEM_OTHER, fn->NRegs + 1, sizeof(IR));
+    char *defs = MemCalloc(MEM_OTHER, fn->NRegs + 1, 1);
+    char *args = MemCalloc(MEM_OTHER, fn->NRegs + 1, 1);
+
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            if (ir->ty == IR_CALL) {
+                for (int i = 0; i < ir->NArgs; i++) args[IRArgs(fn, ir)[i]] = 1;
+            }
+            if (!ir->r0 || defs[ir->r0] == 2) continue;
+            defs[ir->r0]++;
+            if (ir->ty == IR_IMM || ir->ty == IR_BPREL || ir->ty == IR_LABEL_ADDR) remat[ir->r0] = *ir;
+        }
+    }
+    for (int i = 0; i <= fn->NRegs; i++) {
+        if (defs[i] != 1 || args[i]) remat[i].r0 = 0;
     }
 
-    IR *ir2 = calloc(1, sizeof(IR));
-    ir2->ty = IR_STORE_SPILL;
-    ir2->r1 = r;
-    ir2->ID = r->ID;
-    VectorPush(v, ir2);
+    MemFree(defs);
+    MemFree(args);
+    return remat;
 }
 
-void spillLoad(Vector *v, IR *ir, Reg *r) {
-    if (!r || !r->Spill) {
+void spillLoad(Function *fn, IRCursor *c, int reg, IR *remat) {
+    Reg *r = GetReg(fn, reg);
+    if (!reg || !r->Spill) {
         return;
     }
-
-    IR *ir2 = calloc(1, sizeof(IR));
-    ir2->ty = IR_LOAD_SPILL;
-    ir2->r0 = r;
-    ir2->ID = r->ID;
-    VectorPush(v, ir2);
+    if (remat[reg].r0) {
+        IRInsertBefore(c, remat[reg]);
+        return;
+    }
+    IRInsertBefore(c, (IR){.ty = IR_LOAD_SPILL, .r0 = reg, .ID = r->ID});
 }
 
-void emitSpill(BB *bb) {
-    Vector *v = NewVector();
-
-    for (int i = 0; i < VectorSize(bb->IRs); i++) {
-        IR *ir = VectorGet(bb->IRs, i);
+void emitSpill(Function *fn, BB *bb, IR *remat) {
+    IRCursor c;
+    IROpen(&c, bb);
+    for (IR *ir; (ir = IRCur(&c)); IRNext(&c)) {
+        int r0 = ir->r0;
+        int r1 = ir->r1;
+        int r2 = ir->r2;
+
+        // Rematerialized registers are recomputed before each use
+        // instead.
+        while (r0 && remat[r0].r0 && GetReg(fn, r0)->Spill) {
+            IRErase(&c);
+            if (!(ir = IRCur(&c))) break;
+            r0 = ir->r0;
+            r1 = ir->r1;
+            r2 = ir->r2;
+        }
+        if (!ir) break;
+
+        spillLoad(fn, &c, r1, remat);
+        if (r2 != r1 && GetReg(fn, r1)->Spill && GetReg(fn, r2)->Spill) {
+            int spare = AddReg(fn);
+            GetReg(fn, spare)->RealNum = num_regs;
+            if (remat[r2].r0) {
+                IR def = remat[r2];
+                def.r0 = spare;
+                IRInsertBefore(&c, def);
+            } else {
+                IRInsertBefore(&c, (IR){.ty = IR_LOAD_SPILL, .r0 = spare, .ID = GetReg(fn, r2)->ID});
+            }
+            IRCur(&c)->r2 = spare;
+        } else {
+            spillLoad(fn, &c, r2, remat);
+        }
 
-        spillLoad(v, ir, ir->r1);
-        spillLoad(v, ir, ir->r2);
-        spillLoad(v, ir, ir->bbArg);
-        VectorPush(v, ir);
-        spillStore(v, ir);
+        Reg *r = GetReg(fn, r0);
+        if (r0 && r->Spill) {
+            IRInsertAfter(&c, (IR){.ty = IR_STORE_SPILL, .r1 = r0, .ID = r->ID});
+            IRNext(&c); // don't visit the store
+        }
     }
-    bb->IRs = v;
+    IRClose(&c);
 }
 
 // Rewrite
@@ -183,35 +333,66 @@ void emitSpill(BB *bb) {
 // to
 //
 //  NOP
-void optimizeAlloc(IR *ir) {
+int optimizeAlloc(Function *fn, IR *ir) {
     if (ir->ty == IR_MOV) {
-        if (ir->r0->RealNum == ir->r2->RealNum)
+        if (GetReg(fn, ir->r0)->RealNum != GetReg(fn, ir->r2)->RealNum)
+            return 0;
         ir->ty = IR_NOP;
-        return;
+        return 1;
     }
+    return 0;
+}
+
+int Peephole(Function *fn) {
+    int nops = 0;
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        for (int i = 0; i < bb->IRs.len; i++) {
+            nops += optimizeAlloc(fn, IRVecData(&bb->IRs) + i);
+        }
+    }
+    if (StatsEnabled) GetStats(fn)->Nops += nops;
+    return nops > 0;
 }
 
 void Allocate(Program *prog) {
     for (int i = 0; i < VectorSize(prog->Functions); i++) {
         Function *fn = VectorGet(prog->Functions, i);
+        TimerBegin(PHASE_ALLOCATE);
+        Require(fn, ANALYSIS_LIVENESS | ANALYSIS_LOOPS);
 
         // Convert SSA to x86-ish two-address form.
-        for (int i = 0; i < VectorSize(fn->bbs); i++) {
-            BB *bb = VectorGet(fn->bbs, i);
+        char *live = MemCalloc(MEM_OTHER, fn->NRegs + 1, 1);
+        for (int i = 0; i < fn->bbs.len; i++) {
+            BB *bb = BBVecGet(&fn->bbs, i);
+            swapOperands(fn, bb, live);
             optimizeAssign(bb);
         }
+        MemFree(live);
 
         // Allocate registers and decide which registers to spill.
-        Vector *regs = collectRegs(fn);
-        scan(regs);
+        // Recomputing a rematerializable register costs an instruction
+        // without a memory access, and it needs no store.
+        IntVec lines = {0};
+        int remarks = RemarksEnabled(REMARK_MISSED, "regalloc");
+        IntVec regs = collectRegs(fn, remarks ? &lines : NULL);
+        IR *remat = findRemat(fn);
+        for (int i = 0; i < regs.len; i++) {
+            int r = IntVecGet(&regs, i);
+            if (remat[r].r0) GetReg(fn, r)->Cost = (GetReg(fn, r)->Cost + 3) / 4;
+        }
+        scan(fn, &regs, remarks ? &lines : NULL);
+        IntVecFree(&lines);
 
         // Reserve a stack area for spilled registers.
-        for (int i = 0; i < VectorSize(regs); i++) {
-            Reg *r = VectorGet(regs, i);
-            if (!r->Spill)
+        int spilled = 0;
+        for (int i = 0; i < regs.len; i++) {
+            Reg *r = GetReg(fn, IntVecGet(&regs, i));
+            if (!r->Spill || remat[IntVecGet(&regs, i)].r0)
                 continue;
+            spilled++;
 
-            Var *ID = calloc(1, sizeof(Var));
+            Var *ID = MemCalloc(MEM_AST, 1, sizeof(Var));
             ID->ty = PtrTo(&IntType);
             ID->Local = 1;
             ID->Name = "spill";
@@ -219,15 +400,23 @@ void Allocate(Program *prog) {
             r->ID = ID;
             VectorPush(fn->LocalVars, ID);
         }
+        IntVecFree(&regs);
 
-        for (int i = 0; i < VectorSize(fn->bbs); i++) {
-            BB *bb = VectorGet(fn->bbs, i);
+        for (int i = 0; i < fn->bbs.len; i++) {
+            BB *bb = BBVecGet(&fn->bbs, i);
             // Convert accesses to spilled registers to loads and stores.
-            emitSpill(bb);
+            emitSpill(fn, bb, remat);
+        }
+        MemFree(remat);
 
-            for (int i = 0; i < VectorSize(bb->IRs); i++) {
-                optimizeAlloc(VectorGet(bb->IRs, i));
-            }
+        // Registers now hold real register numbers.
+        Invalidate(fn, ANALYSIS_LIVENESS);
+
+        if (StatsEnabled) {
+            GetStats(fn)->Regs = fn->NRegs;
+            GetStats(fn)->Spilled = spilled;
+            StatsStageEnd(fn, "regalloc");
         }
+        TimerEnd(fn->Name);
     }
 }
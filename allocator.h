@@ -5,5 +5,6 @@
 
 extern int num_regs;
 void Allocate(Program *prog);
+int Peephole(Function *fn);
 
 #endif
\ No newline at end of file
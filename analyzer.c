@@ -1,98 +1,221 @@
 // Liveness analysis.
 #include "analyzer.h"
+#include "mem.h"
+#include "pass.h"
+#include "timer.h"
 #include "util.h"
 #include <assert.h>
 #include <stdlib.h>
 
-// Fill bb->succ and bb->pred.
-void addEdges(BB *bb) {
-    if (VectorSize(bb->Succ) > 0) return;
-    assert(bb->IRs->len);
+// Numbers the registers whose value flows from one block into another,
+// i.e. those read in some block before being written there. Only they
+// can be live on block boundaries, so only they get a bit in the
+// liveness sets. index maps register numbers to bit number + 1, or 0
+// for block-local registers.
+void numberRegs(Function *fn, int *index) {
+    int *defined = MemCalloc(MEM_OTHER, fn->NRegs + 1, sizeof(int));
+    IntVec uses = {0};
+    fn->LiveRegs.len = 0;
 
-    IR *ir = VectorLast(bb->IRs);
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        int stamp = i + 1;
+        for (int i = 0; i < bb->Params.len; i++) {
+            defined[IntVecGet(&bb->Params, i)] = stamp;
+        }
+
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            IRUses(fn, ir, &uses);
+            for (int i = 0; i < uses.len; i++) {
+                int r = IntVecGet(&uses, i);
+                if (defined[r] == stamp || index[r]) continue;
+                IntVecPush(&fn->LiveRegs, r);
+                index[r] = fn->LiveRegs.len;
+            }
+            if (ir->r0) defined[ir->r0] = stamp;
+        }
+    }
+
+    IntVecFree(&uses);
+    MemFree(defined);
+}
 
-    if (ir->bb1) {
-        VectorPush(bb->Succ, ir->bb1);
-        VectorPush(ir->bb1->Pred, bb);
-        addEdges(ir->bb1);
+// Initializes bb->DefRegs and bb->UseRegs.
+void scanBB(Function *fn, BB *bb, int *index, IntVec *uses) {
+    for (int i = 0; i < bb->Params.len; i++) {
+        int r = IntVecGet(&bb->Params, i);
+        if (index[r]) BitSetAdd(bb->DefRegs, index[r] - 1);
     }
 
-    if (ir->bb2) {
-        VectorPush(bb->Succ, ir->bb2);
-        VectorPush(ir->bb2->Pred, bb);
-        addEdges(ir->bb2);
+    for (int i = 0; i < bb->IRs.len; i++) {
+        IR *ir = IRVecData(&bb->IRs) + i;
+        IRUses(fn, ir, uses);
+        for (int i = 0; i < uses->len; i++) {
+            int k = index[IntVecGet(uses, i)] - 1;
+            if (k >= 0 && !BitSetContain(bb->DefRegs, k)) BitSetAdd(bb->UseRegs, k);
+        }
+        if (ir->r0 && index[ir->r0]) {
+            BitSetAdd(bb->DefRegs, index[ir->r0] - 1);
+        }
     }
 }
 
-// Initializes bb->def_regs.
-void setDefRegs(BB *bb) {
-    if (bb->Param) {
-        VectorUnion(bb->DefRegs, bb->Param);
+// Solves
+//
+//   Out(bb) = union of In(succ) over the successors of bb
+//   In(bb)  = Use(bb) + (Out(bb) - Def(bb))
+//
+// with a worklist seeded in postorder, which visits successors before
+// their predecessors on acyclic paths and needs one pass per loop
+// nesting level otherwise.
+void ComputeLiveness(Function *fn) {
+    int nbbs = fn->bbs.len;
+    int *index = MemCalloc(MEM_OTHER, fn->NRegs + 1, sizeof(int));
+    IntVec uses = {0};
+    numberRegs(fn, index);
+
+    int n = fn->RPO.len;
+    BB **work = MemCalloc(MEM_OTHER, n, sizeof(BB *));
+    char *queued = MemCalloc(MEM_OTHER, n, 1);
+
+    for (int i = 0; i < nbbs; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        BitSetFree(bb->DefRegs);
+        BitSetFree(bb->UseRegs);
+        BitSetFree(bb->InRegs);
+        BitSetFree(bb->OutRegs);
+        bb->DefRegs = NewBitSet();
+        bb->UseRegs = NewBitSet();
+        bb->InRegs = NewBitSet();
+        bb->OutRegs = NewBitSet();
+        scanBB(fn, bb, index, &uses);
+    }
+    IntVecFree(&uses);
+    MemFree(index);
+
+    // The worklist is a stack; push in reverse postorder so that
+    // blocks are popped in postorder.
+    int top = 0;
+    for (int i = 0; i < n; i++) {
+        work[top++] = BBVecGet(&fn->RPO, i);
+        queued[i] = 1;
     }
 
-    for (int i = 0; i < VectorSize(bb->IRs); i++) {
-        IR *ir = VectorGet(bb->IRs, i);
-        if (ir->r0) {
-            VectorUnion(bb->DefRegs, ir->r0);
+    while (top > 0) {
+        BB *bb = work[--top];
+        queued[bb->RPO] = 0;
+
+        for (int i = 0; i < bb->Succ.len; i++) {
+            BB *succ = BBVecGet(&bb->Succ, i);
+            BitSetUnion(bb->OutRegs, succ->InRegs);
         }
+
+        int changed = BitSetUnion(bb->InRegs, bb->UseRegs);
+        changed |= BitSetUnionDiff(bb->InRegs, bb->OutRegs, bb->DefRegs);
+        if (!changed) continue;
+
+        for (int i = 0; i < bb->Pred.len; i++) {
+            BB *pred = BBVecGet(&bb->Pred, i);
+            if (!queued[pred->RPO]) {
+                work[top++] = pred;
+                queued[pred->RPO] = 1;
+            }
+        }
+    }
+
+    MemFree(work);
+    MemFree(queued);
+
+    // Incoming registers of the entry BB correspond to
+    // uninitialized variables in a program.
+    // Add dummy definitions to make later analysis easy.
+    // They go before the terminator, so that the CFG can still be
+    // recomputed from the last instruction of each block.
+    BB *ent = BBVecGet(&fn->bbs, 0);
+    IR last = IRVecPop(&ent->IRs);
+    for (int i = BitSetNext(ent->InRegs, 0); i >= 0; i = BitSetNext(ent->InRegs, i + 1)) {
+        IRVecPush(&ent->IRs, (IR){.ty = IR_IMM, .r0 = IntVecGet(&fn->LiveRegs, i), .imm = 0});
+        BitSetAdd(ent->DefRegs, i);
     }
+    IRVecPush(&ent->IRs, last);
+    BitSetClear(ent->InRegs);
 }
 
-// Back-propagate r in the call flow graph.
-void propagate(BB *bb, Reg *r) {
-    if (!r || VectorContain(bb->DefRegs, r)) return;
+// Emits the copies dst[i] = src[i], i < n, which happen in parallel,
+// before the terminator of bb: a copy is emitted once no other copy
+// still reads its destination, and a cycle of copies is broken by
+// saving one destination in a new register.
+static void emitParallelCopy(Function *fn, BB *bb, int *dst, int *src, int n) {
+    IR last = IRVecPop(&bb->IRs);
+    while (n > 0) {
+        int i = 0;
+        for (; i < n; i++) {
+            int read = 0;
+            for (int j = 0; j < n; j++) read |= j != i && src[j] == dst[i];
+            if (!read) break;
+        }
 
-    if (!VectorUnion(bb->InRegs, r)) return;
+        if (i == n) {
+            int tmp = AddReg(fn);
+            IRVecPush(&bb->IRs, (IR){.ty = IR_MOV, .r0 = tmp, .r2 = dst[0], .Line = last.Line});
+            for (int j = 0; j < n; j++) {
+                if (src[j] == dst[0]) src[j] = tmp;
+            }
+            continue;
+        }
 
-    for (int i = 0; i < VectorSize(bb->Pred); i++) {
-        BB *pred = VectorGet(bb->Pred, i);
-        if (VectorUnion(pred->OutRegs, r)) {
-            propagate(pred, r);
+        if (dst[i] != src[i]) {
+            IRVecPush(&bb->IRs, (IR){.ty = IR_MOV, .r0 = dst[i], .r2 = src[i], .Line = last.Line});
         }
+        n--;
+        dst[i] = dst[n];
+        src[i] = src[n];
     }
+    IRVecPush(&bb->IRs, last);
 }
 
-// Initializes bb->in_regs and bb->out_regs.
-void visit(BB *bb, IR *ir) {
-    propagate(bb, ir->r1);
-    propagate(bb, ir->r2);
-    propagate(bb, ir->bbArg);
+// Takes fn out of SSA form: the arguments of each jump are copied to
+// the parameters of its target before it, so that block parameters
+// become ordinary registers defined in several places. Jumps are the
+// only edges that pass arguments, so the copies never need a block of
+// their own.
+static void leaveSSA(Function *fn) {
+    IntVec dst = {0}, src = {0};
+    int changed = 0;
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        IR *ir = IRVecData(&bb->IRs) + bb->IRs.len - 1;
+        if (ir->ty != IR_JMP || !ir->NBBArgs) continue;
 
-    if (ir->ty == IR_CALL) {
-        for (int i = 0; i < ir->NArgs; i++) {
-            propagate(bb, ir->Args[i]);
+        BB *to = ir->bb1;
+        assert(ir->NBBArgs == to->Params.len);
+        dst.len = src.len = 0;
+        for (int i = 0; i < ir->NBBArgs; i++) {
+            IntVecPush(&dst, IntVecGet(&to->Params, i));
+            IntVecPush(&src, IRBBArgs(fn, ir)[i]);
         }
+        ir->NBBArgs = 0;
+        emitParallelCopy(fn, bb, IntVecData(&dst), IntVecData(&src), dst.len);
+        changed = 1;
     }
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        bb->Params.len = 0;
+    }
+    IntVecFree(&dst);
+    IntVecFree(&src);
+    if (changed) Invalidate(fn, ANALYSIS_LIVENESS);
 }
 
+// Prepares functions for register allocation: takes them out of SSA
+// form and computes liveness.
 void Analyze(Program *program) {
     for (int i = 0; i < VectorSize(program->Functions); i++) {
         Function *fn = VectorGet(program->Functions, i);
-        addEdges(VectorGet(fn->bbs, 0));
-
-        for (int i = 0; i < VectorSize(fn->bbs); i++) {
-            BB *bb = VectorGet(fn->bbs, i);
-            setDefRegs(bb);
-
-            for (int i = 0; i < VectorSize(bb->IRs); i++) {
-                IR *ir = VectorGet(bb->IRs, i);
-                visit(bb, ir);
-            }
-        }
-
-        // Incoming registers of the entry BB correspond to
-        // uninitialized variables in a program.
-        // Add dummy definitions to make later analysis easy.
-        BB *ent = VectorGet(fn->bbs, 0);
-        for (int i = 0; i < VectorSize(ent->InRegs); i++) {
-            Reg *r = VectorGet(ent->InRegs, i);
-            IR *ir = calloc(1, sizeof(IR));
-            ir->ty = IR_MOV;
-            ir->r0 = r;
-            ir->imm = 0;
-            VectorPush(ent->IRs, ir);
-            VectorPush(ent->DefRegs, r);
-        }
-        ent->InRegs = NewVector();
+        TimerBegin(PHASE_ANALYZE);
+        leaveSSA(fn);
+        Require(fn, ANALYSIS_LIVENESS);
+        TimerEnd(fn->Name);
     }
 }
@@ -3,6 +3,7 @@
 
 #include "ir.h"
 
+void ComputeLiveness(Function *fn);
 void Analyze(Program *program);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,5 +1,8 @@
 #include <stdlib.h>
 #include "ast.h"
+#include "mem.h"
+
+int ASTNodeCount;
 
 int IsNumType(Type *ty) {
     return ty->ty == CHAR ||
@@ -18,7 +21,8 @@ int IsNumExp(Expression *exp) {
 }
 
 Expression *NewExp(ExpType ty, Token *op) {
-    Expression *exp = calloc(1, sizeof(Expression));
+    Expression *exp = MemCalloc(MEM_AST, 1, sizeof(Expression));
+    ASTNodeCount++;
     exp->ty = ty;
     exp->Op = op;
     return exp;
@@ -57,7 +61,6 @@ Expression *NewVarref(Token *op, Var *var) {
     Expression *exp = NewExp(EXP_VARREF, op);
     exp->ctype = var->ty;
     exp->ID = var;
-    var->AddressTaken = 1;
 
     if (var->ty->ty == ARRAY) {
         Expression *tmp = NewExp(EXP_ADDR, op);
@@ -102,7 +105,8 @@ Expression *NewCharExp(char val, Token *op) {
 }
 
 Statement *NewStmt(StmtType ty) {
-    Statement *stmt = calloc(1, sizeof(Statement));
+    Statement *stmt = MemCalloc(MEM_AST, 1, sizeof(Statement));
+    ASTNodeCount++;
     stmt->ty = ty;
     return stmt;
 }
@@ -130,7 +134,7 @@ Expression *NewStmtExp(Token *t, Vector *exps) {
 }
 
 Type *PtrTo(Type *base) {
-    Type *ty = calloc(1, sizeof(Type));
+    Type *ty = MemCalloc(MEM_TYPE, 1, sizeof(Type));
     ty->ty = PTR;
     ty->Size = 8;
     ty->Align = 8;
@@ -139,7 +143,7 @@ Type *PtrTo(Type *base) {
 }
 
 Type *ArrayOf(Type *base, int len) {
-    Type *ty = calloc(1, sizeof(Type));
+    Type *ty = MemCalloc(MEM_TYPE, 1, sizeof(Type));
     ty->ty = ARRAY;
     ty->Size = base->Size * len;
     ty->Align = base->Align;
@@ -149,7 +153,7 @@ Type *ArrayOf(Type *base, int len) {
 }
 
 Type *NewType(int ty, int size) {
-    Type *ret = calloc(1, sizeof(Type));
+    Type *ret = MemCalloc(MEM_TYPE, 1, sizeof(Type));
     ret->ty = ty;
     ret->Size = size;
     ret->Align = size;
@@ -157,13 +161,13 @@ Type *NewType(int ty, int size) {
 }
 
 Type *NewFuncType(Type *returning) {
-    Type *ty = calloc(1, sizeof(Type));
+    Type *ty = MemCalloc(MEM_TYPE, 1, sizeof(Type));
     ty->Returning = returning;
     return ty;
 }
 
 Var *NewVar(Type *ty, char *name, int local) {
-    Var *var = calloc(1, sizeof(Var));
+    Var *var = MemCalloc(MEM_AST, 1, sizeof(Var));
     var->ty = ty;
     var->Name = name;
     var->Local = local;
@@ -171,12 +175,13 @@ Var *NewVar(Type *ty, char *name, int local) {
 }
 
 Function *NewFunction() {
-    Function *fn = calloc(1, sizeof(Function));
+    Function *fn = MemCalloc(MEM_AST, 1, sizeof(Function));
+    RegVecPush(&fn->Regs, (Reg){0}); // register 0 is "no register"
     return fn;
 }
 
 Program *NewProgram() {
-    Program *program = calloc(1, sizeof(Program));
+    Program *program = MemCalloc(MEM_AST, 1, sizeof(Program));
     program->GlobalVars = NewVector();
     program->Functions = NewVector();
     return program;
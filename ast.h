@@ -75,6 +75,9 @@ typedef struct Statement Statement;
 typedef struct Function Function;
 typedef struct Program Program;
 typedef struct BB BB;
+typedef struct Stats Stats;
+
+DEFINE_VEC(BBVec, BB *)
 
 enum CType {
     VOID,
@@ -167,7 +170,7 @@ struct Var {
 
     // For optimization passes.
     int AddressTaken;
-    Reg *Promoted;
+    int Promoted; // whether mem2reg replaced the variable by registers
 };
 
 Var *NewVar(Type *ty, char *name, int local);
@@ -261,17 +264,63 @@ static Statement NullStmt = {STMT_NULL};
 Statement *NewExpStmt(Token *t, Expression *exp);
 Statement *NewStmt(StmtType ty);
 
+// The number of expressions and statements created so far.
+extern int ASTNodeCount;
+
+// A virtual register. Registers live in Function.Regs and are referred
+// to by their number, the index there; number 0 means no register.
+struct Reg {
+    int RealNum; // real register number
+
+    // For regalloc
+    int Def;
+    int LastUse;
+    int Cost; // of spilling: uses and definitions weighted by loop depth
+    int Hint; // a register it is copied from or to, to share a register with
+    int Spill;
+    Var *ID;
+};
+
+DEFINE_STRUCT_VEC(RegVec, Reg, MEM_REG)
+
 struct Function {
     char *Name;
+    int Line;
     Statement *Stmt;
     Vector *Params;
     Vector *LocalVars;
-    Vector *bbs;
+    BBVec bbs;
+
+    // Virtual registers are numbered 1..NRegs; Regs holds them by
+    // number, with an unused slot 0.
+    int NRegs;
+    RegVec Regs;
+
+    // Arguments of all calls, indexed by IR.Args.
+    IntVec Args;
+
+    // For pass manager: the analyses that are up to date.
+    int Analyses;
+
+    // For control flow analysis: the reachable blocks in reverse
+    // postorder.
+    BBVec RPO;
+
+    // For loop analysis: all natural loops, inner loops first.
+    Vector *Loops;
+
+    // For liveness analysis: the registers that can be live on block
+    // boundaries, indexed by their bit in BB.InRegs and BB.OutRegs.
+    IntVec LiveRegs;
+
+    // For -stats=json
+    Stats *Stats;
 };
 
 Function *NewFunction();
 
 struct Program {
+    char *File; // source file name, NULL if unknown
     Vector *GlobalVars;
     Vector *Functions;
     Map *macros;
@@ -279,31 +328,4 @@ struct Program {
 
 Program *NewProgram();
 
-struct Reg {
-    int VirtualNum; // virtual register number
-    int RealNum; // real register number
-
-    // For optimizer
-    Reg *Promoted;
-
-    // For regalloc
-    int Def;
-    int LastUse;
-    int Spill;
-    Var *ID;
-};
-
-struct BB {
-    int Label;
-    Vector *IRs;
-    Reg *Param;
-
-    // For liveness analysis
-    Vector *Succ;
-    Vector *Pred;
-    Vector *DefRegs;
-    Vector *InRegs;
-    Vector *OutRegs;
-};
-
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,60 @@
+#!/bin/sh
+# Measures compile throughput on programs from gensrc.sh, scaling one
+# axis at a time from a base configuration. Prints a JSON array with,
+# for each configuration, lines/sec, tokens/sec, the time spent in
+# each phase and the peak RSS. Each configuration is compiled RUNS
+# times (default 3) and the fastest run is reported.
+xacc=${XACC:-./xacc}
+runs=${RUNS:-3}
+dir=$(dirname "$0")
+tmp=${TMPDIR:-/tmp}/xacc-bench-$$
+trap 'rm -f "$tmp.c" "$tmp.err"' EXIT
+
+base="-f 10 -s 100 -d 4 -l 4 -g 10 -S 10 -m 10"
+
+bench() {
+    name=$1
+    shift
+    sh "$dir/gensrc.sh" $base "$@" > "$tmp.c"
+    lines=$(wc -l < "$tmp.c")
+
+    best=
+    for i in $(seq "$runs"); do
+        if ! $xacc -ftime-report -fmem-report "$tmp.c" 2> "$tmp.err" > /dev/null; then
+            cat "$tmp.err" >&2
+            exit 1
+        fi
+        total=$(awk '$1 == "total" && NF == 3 { print $2 }' "$tmp.err")
+        if [ -z "$best" ] || awk -v a="$total" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+            best=$total
+            cp "$tmp.err" "$tmp.best"
+        fi
+    done
+
+    awk -v name="$name" -v args="$base${1:+ $*}" -v lines="$lines" -v sep="$sep" '
+        $1 == "total" && NF == 3 { total = $2 }
+        /%\)/ && $1 != "total" { phases = phases (phases ? ", " : "") "\"" $1 "\": " $2 }
+        $1 == "tokens" { tokens = $2 }
+        $1 == "peak" { rss = $3 }
+        END {
+            printf "%s  {\"config\": \"%s\", \"args\": \"%s\", \"lines\": %d, \"tokens\": %d, ", sep, name, args, lines, tokens
+            printf "\"seconds\": %s, \"lines_per_sec\": %.0f, \"tokens_per_sec\": %.0f, ", total, lines / total, tokens / total
+            printf "\"phases\": {%s}, \"peak_rss_kib\": %d}", phases, rss
+        }' "$tmp.best"
+    rm -f "$tmp.best"
+    sep=",
+"
+}
+
+echo "["
+sep=
+bench base
+bench functions -f 100
+bench statements -s 1000
+bench depth -d 16
+bench locals -l 64
+bench globals -g 1000
+bench strings -S 1000
+bench macros -m 1000
+echo
+echo "]"
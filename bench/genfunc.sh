@@ -0,0 +1,20 @@
+#!/bin/sh
+# Prints a C file with one function of about N statements, for
+# benchmarking the per-function passes. Every statement branches, so
+# the function has a few blocks per statement and values that stay
+# live across them.
+n=${1:-1000}
+awk -v n="$n" 'BEGIN {
+    print "int big(int a, int b, int c) {"
+    print "    int x = 0; int y = 1;"
+    print "    while (a < 100) {"
+    for (i = 0; i < n; i++) {
+        printf "        x = x + ((a + %d) && b) * ((b - %d) || c) + (c > %d ? a : y);\n", i, i, i
+        if (i % 10 == 9) printf "        if (x > %d) y = y + x; else a = a + 1;\n", i
+    }
+    print "        a = a + 1;"
+    print "    }"
+    print "    return x + y;"
+    print "}"
+    print "int main() { return big(1, 2, 3) & 0; }"
+}'
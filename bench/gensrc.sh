@@ -0,0 +1,105 @@
+#!/bin/sh
+# Prints a synthetic C program in the subset xacc accepts, for
+# benchmarking compile throughput. Each option scales one axis:
+#
+#   -f N   functions
+#   -s N   statements per function
+#   -d N   expression nesting depth
+#   -l N   locals per scope (a scope is opened every 10 statements)
+#   -g N   global variables
+#   -S N   distinct string literals
+#   -m N   object-like macros
+#   -r N   random seed
+#
+# The program is only meant to be compiled: its functions call each
+# other and loop on values that are never checked.
+funcs=10 stmts=100 depth=4 locals=4 globals=10 strings=10 macros=10 seed=1
+while getopts f:s:d:l:g:S:m:r: opt; do
+    case $opt in
+    f) funcs=$OPTARG ;;
+    s) stmts=$OPTARG ;;
+    d) depth=$OPTARG ;;
+    l) locals=$OPTARG ;;
+    g) globals=$OPTARG ;;
+    S) strings=$OPTARG ;;
+    m) macros=$OPTARG ;;
+    r) seed=$OPTARG ;;
+    *) echo "usage: $0 [-f funcs] [-s stmts] [-d depth] [-l locals] [-g globals] [-S strings] [-m macros] [-r seed]" >&2
+       exit 1 ;;
+    esac
+done
+
+awk -v funcs="$funcs" -v stmts="$stmts" -v depth="$depth" -v locals="$locals" \
+    -v globals="$globals" -v strings="$strings" -v macros="$macros" -v seed="$seed" '
+function rnd(n) { return int(rand() * n) }
+
+# A variable, global, macro or constant visible in the current scope.
+function leaf(    k) {
+    k = rnd(4)
+    if (k == 0 && nvars > 0) return vars[rnd(nvars)]
+    if (k == 1 && globals > 0) return "g" rnd(globals)
+    if (k == 2 && macros > 0) return "M" rnd(macros)
+    if (k == 3 && nvars > 0) return vars[rnd(nvars)]
+    return rnd(100)
+}
+
+# An expression nested d levels deep.
+function expr(d,    ops) {
+    if (d <= 0) return leaf()
+    split("+ - * & | ^ < == !=", ops, " ")
+    return "(" leaf() " " ops[1 + rnd(9)] " " expr(d - 1) ")"
+}
+
+function stmt(f, ind,    k, v) {
+    k = rnd(10)
+    v = vars[rnd(nvars)]
+    if (k < 5) {
+        print ind v " = " expr(depth) ";"
+    } else if (k < 7) {
+        print ind "if (" expr(depth) ") " v " = " expr(depth) "; else " v " = " leaf() ";"
+    } else if (k == 7) {
+        print ind "while (" v " > " leaf() ") " v " = " v " - 1;"
+    } else if (k == 8 && f > 0) {
+        print ind v " = f" rnd(f) "(" expr(depth) ", " leaf() ");"
+    } else if (strings > 0) {
+        print ind "puts(\"string literal number " rnd(strings) "\");"
+    } else {
+        print ind v " = " v " + 1;"
+    }
+}
+
+BEGIN {
+    srand(seed)
+    print "int puts(char *s);"
+    for (i = 0; i < macros; i++) print "#define M" i " " i
+    for (i = 0; i < globals; i++) print "int g" i ";"
+
+    for (f = 0; f < funcs; f++) {
+        print ""
+        print "int f" f "(int a, int b) {"
+        nvars = 2
+        vars[0] = "a"
+        vars[1] = "b"
+        for (s = 0; s < stmts; s++) {
+            if (s % 10 == 0) {
+                if (s > 0) print "    }"
+                print "    {"
+                nvars = 2
+                for (i = 0; i < locals; i++) {
+                    print "        int v" i " = " leaf() ";"
+                    vars[nvars++] = "v" i
+                }
+            }
+            stmt(f, "        ")
+        }
+        if (stmts > 0) print "    }"
+        print "    return a + b;"
+        print "}"
+    }
+
+    print ""
+    print "int main() {"
+    if (funcs > 0) print "    return f" funcs - 1 "(1, 2) & 0;"
+    else print "    return 0;"
+    print "}"
+}'
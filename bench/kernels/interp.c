@@ -0,0 +1,90 @@
+// A switch-based interpreter for a small stack machine, running a
+// program that sums i * 3 modulo 1000003 for i below 3000000.
+int printf(char *fmt);
+
+int code[64];
+int stack[64];
+int vars[8];
+
+int run(int *pc0) {
+    int *pc = pc0;
+    int sp = 0;
+    while (1) {
+        int op = *pc++;
+        switch (op) {
+        case 0: // halt
+            return stack[sp - 1];
+        case 1: // push imm
+            stack[sp++] = *pc++;
+            break;
+        case 2: // load var
+            stack[sp++] = vars[*pc++];
+            break;
+        case 3: // store var
+            vars[*pc++] = stack[--sp];
+            break;
+        case 4: // add
+            sp--;
+            stack[sp - 1] = stack[sp - 1] + stack[sp];
+            break;
+        case 5: // sub
+            sp--;
+            stack[sp - 1] = stack[sp - 1] - stack[sp];
+            break;
+        case 6: // mul
+            sp--;
+            stack[sp - 1] = stack[sp - 1] * stack[sp];
+            break;
+        case 7: // mod
+            sp--;
+            stack[sp - 1] = stack[sp - 1] % stack[sp];
+            break;
+        case 8: // less than
+            sp--;
+            stack[sp - 1] = stack[sp - 1] < stack[sp];
+            break;
+        case 9: // jump
+            pc = pc0 + *pc;
+            break;
+        case 10: // jump if zero
+            if (stack[--sp] == 0) pc = pc0 + *pc;
+            else pc++;
+            break;
+        default:
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int emit(int n, int op) {
+    code[n] = op;
+    return n + 1;
+}
+
+int main() {
+    int n = 0;
+    // sum = 0; i = 0
+    n = emit(n, 1); n = emit(n, 0); n = emit(n, 3); n = emit(n, 0);
+    n = emit(n, 1); n = emit(n, 0); n = emit(n, 3); n = emit(n, 1);
+    // loop: if (!(i < 3000000)) goto done
+    int loop = n;
+    n = emit(n, 2); n = emit(n, 1); n = emit(n, 1); n = emit(n, 3000000);
+    n = emit(n, 8); n = emit(n, 10);
+    int patch = n;
+    n = emit(n, 0);
+    // sum = (sum + i * 3) % 1000003
+    n = emit(n, 2); n = emit(n, 0);
+    n = emit(n, 2); n = emit(n, 1); n = emit(n, 1); n = emit(n, 3);
+    n = emit(n, 6); n = emit(n, 4); n = emit(n, 1); n = emit(n, 1000003);
+    n = emit(n, 7); n = emit(n, 3); n = emit(n, 0);
+    // i = i + 1; goto loop
+    n = emit(n, 2); n = emit(n, 1); n = emit(n, 1); n = emit(n, 1);
+    n = emit(n, 4); n = emit(n, 3); n = emit(n, 1);
+    n = emit(n, 9); n = emit(n, loop);
+    // done: push sum; halt
+    code[patch] = n;
+    n = emit(n, 2); n = emit(n, 0); n = emit(n, 0);
+    printf("%d\n", run(code));
+    return 0;
+}
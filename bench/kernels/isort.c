@@ -0,0 +1,33 @@
+// Insertion sort of 10000 pseudo-random ints.
+int printf(char *fmt);
+
+int v[10000];
+
+void isort(int *p, int n) {
+    int i;
+    for (i = 1; i < n; i++) {
+        int x = p[i];
+        int j = i - 1;
+        while (j >= 0 && p[j] > x) {
+            p[j + 1] = p[j];
+            j--;
+        }
+        p[j + 1] = x;
+    }
+}
+
+int main() {
+    int n = 10000;
+    int seed = 7;
+    int i;
+    for (i = 0; i < n; i++) {
+        seed = (seed * 75 + 74) % 65537;
+        v[i] = seed;
+    }
+    isort(v, n);
+    int sorted = 1;
+    for (i = 1; i < n; i++)
+        if (v[i - 1] > v[i]) sorted = 0;
+    printf("%d %d %d %d\n", sorted, v[0], v[n / 2], v[n - 1]);
+    return 0;
+}
@@ -0,0 +1,35 @@
+// Integer matrix multiply: C = A * B for 300x300 matrices.
+int printf(char *fmt);
+
+int a[300][300];
+int b[300][300];
+int c[300][300];
+
+int main() {
+    int n = 300;
+    int seed = 1;
+    int i;
+    int j;
+    int k;
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+            seed = (seed * 75 + 74) % 65537;
+            a[i][j] = seed % 100;
+            seed = (seed * 75 + 74) % 65537;
+            b[i][j] = seed % 100;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+            int sum = 0;
+            for (k = 0; k < n; k++) sum += a[i][k] * b[k][j];
+            c[i][j] = sum;
+        }
+    }
+    int check = 0;
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++)
+            check = (check * 31 + c[i][j]) % 1000003;
+    printf("%d %d %d\n", c[0][0], c[n - 1][n - 1], check);
+    return 0;
+}
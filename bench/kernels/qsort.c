@@ -0,0 +1,47 @@
+// Quicksort of 1000000 pseudo-random ints.
+int printf(char *fmt);
+
+int v[1000000];
+
+void quicksort(int *p, int lo, int hi) {
+    while (lo < hi) {
+        int pivot = p[(lo + hi) / 2];
+        int i = lo;
+        int j = hi;
+        while (i <= j) {
+            while (p[i] < pivot) i++;
+            while (p[j] > pivot) j--;
+            if (i <= j) {
+                int t = p[i];
+                p[i] = p[j];
+                p[j] = t;
+                i++;
+                j--;
+            }
+        }
+        // Recurse into the smaller half, loop on the larger one.
+        if (j - lo < hi - i) {
+            quicksort(p, lo, j);
+            lo = i;
+        } else {
+            quicksort(p, i, hi);
+            hi = j;
+        }
+    }
+}
+
+int main() {
+    int n = 1000000;
+    int seed = 11;
+    int i;
+    for (i = 0; i < n; i++) {
+        seed = (seed * 75 + 74) % 65537;
+        v[i] = seed * 16 + i % 16;
+    }
+    quicksort(v, 0, n - 1);
+    int sorted = 1;
+    for (i = 1; i < n; i++)
+        if (v[i - 1] > v[i]) sorted = 0;
+    printf("%d %d %d %d\n", sorted, v[0], v[n / 2], v[n - 1]);
+    return 0;
+}
@@ -0,0 +1,25 @@
+// Sieve of Eratosthenes: counts the primes below 2000000, ten times.
+int printf(char *fmt);
+
+char composite[2000000];
+
+int sieve(int n) {
+    int i;
+    int j;
+    int count = 0;
+    for (i = 0; i < n; i++) composite[i] = 0;
+    for (i = 2; i < n; i++) {
+        if (composite[i]) continue;
+        count++;
+        for (j = i + i; j < n; j += i) composite[j] = 1;
+    }
+    return count;
+}
+
+int main() {
+    int i;
+    int count;
+    for (i = 0; i < 10; i++) count = sieve(2000000);
+    printf("%d\n", count);
+    return 0;
+}
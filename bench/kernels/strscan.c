@@ -0,0 +1,68 @@
+// String scanning: builds a text of words and counts its words,
+// vowels, lines and the occurrences of a pattern, fifty times.
+int printf(char *fmt);
+
+char text[200000];
+
+int length(char *s) {
+    int n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+int isvowel(int c) {
+    return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+}
+
+int count(char *s, char *pat) {
+    int m = length(pat);
+    int n = 0;
+    int i;
+    for (i = 0; s[i]; i++) {
+        int k = 0;
+        while (k < m && s[i + k] == pat[k]) k++;
+        if (k == m) n++;
+    }
+    return n;
+}
+
+int main() {
+    char *words = "the quick brown fox jumps over the lazy dog and then some more ";
+    int len = length(words);
+    int n = 0;
+    int seed = 3;
+    while (n < 199000) {
+        seed = (seed * 75 + 74) % 65537;
+        int i;
+        for (i = seed % len; i < len; i++) text[n++] = words[i];
+        if (seed % 7 == 0) text[n++] = '\n';
+    }
+    text[n] = 0;
+
+    int nwords;
+    int nvowels;
+    int nlines;
+    int nthe;
+    int round;
+    for (round = 0; round < 50; round++) {
+        nwords = 0;
+        nvowels = 0;
+        nlines = 0;
+        int inword = 0;
+        int i;
+        for (i = 0; text[i]; i++) {
+            int c = text[i];
+            if (c == ' ' || c == '\n') {
+                inword = 0;
+                if (c == '\n') nlines++;
+            } else {
+                if (!inword) nwords++;
+                inword = 1;
+                if (isvowel(c)) nvowels++;
+            }
+        }
+        nthe = count(text, "the ");
+    }
+    printf("%d %d %d %d %d\n", length(text), nwords, nvowels, nlines, nthe);
+    return 0;
+}
@@ -0,0 +1,10 @@
+#!/bin/sh
+# Times liveness analysis on generated functions of growing size.
+xacc=${XACC:-./xacc}
+tmp=${TMPDIR:-/tmp}/xacc-bench-$$.c
+trap 'rm -f "$tmp"' EXIT
+
+for n in 500 1000 2000 4000 8000; do
+    sh "$(dirname "$0")/genfunc.sh" $n > "$tmp"
+    $xacc -ftime-report "$tmp" 2>&1 >/dev/null | awk -v n=$n '$1 == "analyze" { printf "%6d statements: analyze %s s\n", n, $2 }'
+done
@@ -0,0 +1,64 @@
+#!/bin/sh
+# Measures how fast the code xacc generates runs. Each kernel in
+# kernels/ is compiled with xacc (and XACCFLAGS, if set), linked with
+# CC and run; its output must match kernels/<name>.out. Prints a JSON
+# array with, for each kernel, whether the output matched, the wall
+# time of the fastest of RUNS runs (default 3), and the assembly
+# instructions and spilled registers reported by -stats=json.
+xacc=${XACC:-./xacc}
+cc=${CC:-cc}
+runs=${RUNS:-3}
+dir=$(dirname "$0")/kernels
+tmp=${TMPDIR:-/tmp}/xacc-bench-$$
+trap 'rm -f "$tmp.s" "$tmp.bin" "$tmp.out" "$tmp.err"' EXIT
+
+now() {
+    date +%s.%N
+}
+
+status=0
+
+bench() {
+    name=$1
+    if ! $xacc $XACCFLAGS -stats=json "$dir/$name.c" > "$tmp.s" 2> "$tmp.err" ||
+       ! $cc -no-pie -o "$tmp.bin" "$tmp.s" 2>> "$tmp.err"; then
+        cat "$tmp.err" >&2
+        exit 1
+    fi
+    stats=$(awk '/"total"/ { print $0 }' "$tmp.err")
+
+    ok=true
+    best=
+    for i in $(seq "$runs"); do
+        start=$(now)
+        "$tmp.bin" > "$tmp.out"
+        end=$(now)
+        if ! cmp -s "$tmp.out" "$dir/$name.out"; then
+            echo "$name: wrong output" >&2
+            ok=false
+            status=1
+            break
+        fi
+        t=$(awk -v a="$start" -v b="$end" 'BEGIN { printf "%.6f", b - a }')
+        if [ -z "$best" ] || awk -v a="$t" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+            best=$t
+        fi
+    done
+
+    echo "$stats" | awk -v name="$name" -v ok="$ok" -v t="${best:-0}" -v sep="$sep" '{
+        match($0, /"asm_insts": [0-9]+/); insts = substr($0, RSTART + 13, RLENGTH - 13)
+        match($0, /"spilled": [0-9]+/); spilled = substr($0, RSTART + 11, RLENGTH - 11)
+        printf "%s  {\"kernel\": \"%s\", \"ok\": %s, \"seconds\": %s, \"asm_insts\": %d, \"spilled\": %d}", sep, name, ok, t, insts, spilled
+    }'
+    sep=",
+"
+}
+
+echo "["
+sep=
+for f in "$dir"/*.c; do
+    bench "$(basename "$f" .c)"
+done
+echo
+echo "]"
+exit $status
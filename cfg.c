@@ -0,0 +1,274 @@
+// Control flow, dominator and loop analysis.
+//
+// None of these recurse over the CFG, so arbitrarily deep or long
+// functions can't overflow the stack.
+#include "cfg.h"
+#include "mem.h"
+#include <assert.h>
+
+static void addEdge(BB *from, BB *to) {
+    BBVecPush(&from->Succ, to);
+    BBVecPush(&to->Pred, from);
+}
+
+static void resetVector(Vector **v) {
+    if (*v) (*v)->len = 0;
+    else *v = NewVector();
+}
+
+// Fills bb->Succ and bb->Pred for the blocks reachable from the entry
+// and numbers them in reverse postorder.
+void ComputeCFG(Function *fn) {
+    int n = fn->bbs.len;
+    for (int i = 0; i < n; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        bb->Succ.len = 0;
+        bb->Pred.len = 0;
+        bb->RPO = -1;
+    }
+
+    // Depth-first search with an explicit stack. next[i] is the
+    // successor of stack[i] to visit next.
+    BB **stack = MemMalloc(MEM_OTHER, sizeof(BB *) * n);
+    int *next = MemMalloc(MEM_OTHER, sizeof(int) * n);
+    BBVec post = {0};
+    int top = 0;
+
+    BB *ent = BBVecGet(&fn->bbs, 0);
+    stack[top] = ent;
+    next[top++] = 0;
+    ent->RPO = 0; // visited
+
+    while (top > 0) {
+        BB *bb = stack[top - 1];
+        if (next[top - 1] == 0 && bb->Succ.len == 0) {
+            assert(bb->IRs.len);
+            IR ir = IRVecLast(&bb->IRs);
+            if (ir.ty == IR_JMP || ir.ty == IR_TEST) addEdge(bb, ir.bb1);
+            if (ir.ty == IR_TEST) addEdge(bb, ir.bb2);
+        }
+
+        if (next[top - 1] < bb->Succ.len) {
+            BB *succ = BBVecGet(&bb->Succ, next[top - 1]++);
+            if (succ->RPO < 0) {
+                succ->RPO = 0;
+                stack[top] = succ;
+                next[top++] = 0;
+            }
+            continue;
+        }
+        BBVecPush(&post, bb);
+        top--;
+    }
+
+    fn->RPO.len = 0;
+    for (int i = post.len - 1; i >= 0; i--) {
+        BB *bb = BBVecGet(&post, i);
+        bb->RPO = fn->RPO.len;
+        BBVecPush(&fn->RPO, bb);
+    }
+
+    BBVecFree(&post);
+    MemFree(stack);
+    MemFree(next);
+}
+
+static BB *intersect(BB *b1, BB *b2) {
+    while (b1 != b2) {
+        while (b1->RPO > b2->RPO) b1 = b1->IDom;
+        while (b2->RPO > b1->RPO) b2 = b2->IDom;
+    }
+    return b1;
+}
+
+// Numbers the dominator tree in preorder and postorder, so that
+// dominance can be tested in constant time.
+static void numberDomTree(Function *fn) {
+    int n = fn->RPO.len;
+    BB **stack = MemMalloc(MEM_OTHER, sizeof(BB *) * n);
+    int *next = MemMalloc(MEM_OTHER, sizeof(int) * n);
+    int top = 0, pre = 0, post = 0;
+
+    BB *ent = BBVecGet(&fn->RPO, 0);
+    stack[top] = ent;
+    next[top++] = 0;
+    ent->DomPre = pre++;
+
+    while (top > 0) {
+        BB *bb = stack[top - 1];
+        if (next[top - 1] < bb->DomChildren.len) {
+            BB *child = BBVecGet(&bb->DomChildren, next[top - 1]++);
+            child->DomPre = pre++;
+            stack[top] = child;
+            next[top++] = 0;
+            continue;
+        }
+        bb->DomPost = post++;
+        top--;
+    }
+
+    MemFree(stack);
+    MemFree(next);
+}
+
+// Computes immediate dominators with the algorithm of Cooper, Harvey
+// and Kennedy, "A Simple, Fast Dominance Algorithm", and from them
+// the dominator tree.
+void ComputeDominators(Function *fn) {
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        bb->IDom = NULL;
+        bb->DomChildren.len = 0;
+        bb->DomPre = bb->DomPost = -1;
+    }
+
+    int n = fn->RPO.len;
+    BB *ent = BBVecGet(&fn->RPO, 0);
+    ent->IDom = ent;
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (int i = 1; i < n; i++) {
+            BB *bb = BBVecGet(&fn->RPO, i);
+            BB *idom = NULL;
+            for (int i = 0; i < bb->Pred.len; i++) {
+                BB *pred = BBVecGet(&bb->Pred, i);
+                if (!pred->IDom) continue;
+                idom = idom ? intersect(pred, idom) : pred;
+            }
+            if (bb->IDom != idom) {
+                bb->IDom = idom;
+                changed = 1;
+            }
+        }
+    }
+    ent->IDom = NULL;
+
+    for (int i = 1; i < n; i++) {
+        BB *bb = BBVecGet(&fn->RPO, i);
+        BBVecPush(&bb->IDom->DomChildren, bb);
+    }
+    numberDomTree(fn);
+}
+
+// Returns whether a dominates b. Unreachable blocks dominate and are
+// dominated by nothing.
+int Dominates(BB *a, BB *b) {
+    if (a->RPO < 0 || b->RPO < 0) return 0;
+    return a->DomPre <= b->DomPre && b->DomPost <= a->DomPost;
+}
+
+// Computes dominance frontiers, again after Cooper, Harvey and
+// Kennedy: a join point is in the frontier of every block on the
+// dominator tree path from each of its predecessors up to, but not
+// including, its immediate dominator.
+void ComputeFrontiers(Function *fn) {
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        bb->Frontier.len = 0;
+    }
+
+    for (int i = 0; i < fn->RPO.len; i++) {
+        BB *bb = BBVecGet(&fn->RPO, i);
+        if (bb->Pred.len < 2) continue;
+        for (int i = 0; i < bb->Pred.len; i++) {
+            for (BB *runner = BBVecGet(&bb->Pred, i); runner != bb->IDom; runner = runner->IDom) {
+                BBVecUnion(&runner->Frontier, bb);
+            }
+        }
+    }
+}
+
+// Finds natural loops. Headers are visited in postorder, so inner
+// loops are found before the loops that contain them; a block found
+// again by an outer loop links its innermost loop's outermost known
+// ancestor to the outer loop.
+void ComputeLoops(Function *fn) {
+    for (int i = 0; fn->Loops && i < VectorSize(fn->Loops); i++) {
+        Loop *loop = VectorGet(fn->Loops, i);
+        BBVecFree(&loop->Blocks);
+        MemFree(loop);
+    }
+    resetVector(&fn->Loops);
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        bb->Loop = NULL;
+    }
+
+    int n = fn->RPO.len;
+    int *mark = MemCalloc(MEM_OTHER, n, sizeof(int));
+    BB **work = MemMalloc(MEM_OTHER, sizeof(BB *) * n);
+
+    for (int i = n - 1; i >= 0; i--) {
+        BB *header = BBVecGet(&fn->RPO, i);
+        Loop *loop = NULL;
+        int top = 0;
+
+        // Seed the walk with the sources of the back edges.
+        for (int i = 0; i < header->Pred.len; i++) {
+            BB *pred = BBVecGet(&header->Pred, i);
+            if (!Dominates(header, pred)) continue;
+            if (!loop) {
+                loop = MemCalloc(MEM_OTHER, 1, sizeof(Loop));
+                loop->Header = header;
+                VectorPush(fn->Loops, loop);
+                mark[header->RPO] = VectorSize(fn->Loops);
+                BBVecPush(&loop->Blocks, header);
+            }
+            if (mark[pred->RPO] != VectorSize(fn->Loops)) {
+                mark[pred->RPO] = VectorSize(fn->Loops);
+                work[top++] = pred;
+                BBVecPush(&loop->Blocks, pred);
+            }
+        }
+        if (!loop) continue;
+
+        while (top > 0) {
+            BB *bb = work[--top];
+            for (int i = 0; i < bb->Pred.len; i++) {
+                BB *pred = BBVecGet(&bb->Pred, i);
+                if (mark[pred->RPO] == VectorSize(fn->Loops)) continue;
+                mark[pred->RPO] = VectorSize(fn->Loops);
+                work[top++] = pred;
+                BBVecPush(&loop->Blocks, pred);
+            }
+        }
+
+        for (int i = 0; i < loop->Blocks.len; i++) {
+            BB *bb = BBVecGet(&loop->Blocks, i);
+            if (!bb->Loop) {
+                bb->Loop = loop;
+                continue;
+            }
+            Loop *inner = bb->Loop;
+            while (inner->Parent) inner = inner->Parent;
+            if (inner != loop) inner->Parent = loop;
+        }
+    }
+
+    // Parents come after their children.
+    for (int i = VectorSize(fn->Loops) - 1; i >= 0; i--) {
+        Loop *loop = VectorGet(fn->Loops, i);
+        loop->Depth = loop->Parent ? loop->Parent->Depth + 1 : 1;
+    }
+
+    MemFree(mark);
+    MemFree(work);
+}
+
+int LoopDepth(BB *bb) {
+    return bb->Loop ? bb->Loop->Depth : 0;
+}
+
+// Drops the blocks the CFG, which must be up to date, finds
+// unreachable. Returns whether there were any. The rest of the CFG
+// and the dominator tree stay valid.
+int RemoveUnreachable(Function *fn) {
+    int n = 0;
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        if (bb->RPO >= 0) BBVecSet(&fn->bbs, n++, bb);
+    }
+    int changed = n != fn->bbs.len;
+    fn->bbs.len = n;
+    return changed;
+}
@@ -0,0 +1,14 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "ir.h"
+
+void ComputeCFG(Function *fn);
+void ComputeDominators(Function *fn);
+void ComputeFrontiers(Function *fn);
+void ComputeLoops(Function *fn);
+int Dominates(BB *a, BB *b);
+int LoopDepth(BB *bb);
+int RemoveUnreachable(Function *fn);
+
+#endif
@@ -0,0 +1,184 @@
+// Dead code elimination.
+//
+// Mark and sweep: instructions with effects beyond their result are
+// live, i.e. stores, calls, returns and branches, and so is whatever
+// computes a register a live instruction reads. A jump only reads the
+// arguments for the live parameters of its target. Everything else is
+// removed, with the parameters nothing reads and the arguments passed
+// to them, after the blocks unreachable from the entry.
+#include "dce.h"
+#include "cfg.h"
+#include "mem.h"
+#include "pass.h"
+
+typedef struct DCE {
+    Function *fn;
+    DefUse *du;
+    IntVec *defs;   // per register, if not in SSA form: its sites
+    IntVec *params; // per register: pairs of a block index and a parameter index
+    char *live;     // per register
+    char *marked;   // per site
+    IntVec work;    // live registers whose definitions are unmarked
+} DCE;
+
+static int hasEffect(IRType ty) {
+    switch (ty) {
+    case IR_RETURN:
+    case IR_CALL:
+    case IR_JMP:
+    case IR_TEST:
+    case IR_STORE:
+    case IR_STORE_ARG:
+    case IR_STORE_SPILL:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static void markReg(DCE *d, int r) {
+    if (!r || d->live[r]) return;
+    d->live[r] = 1;
+    IntVecPush(&d->work, r);
+}
+
+static void markSite(DCE *d, int k) {
+    if (d->marked[k]) return;
+    d->marked[k] = 1;
+
+    IR *ir = SiteIR(&d->du->Sites[k]);
+    markReg(d, ir->r1);
+    markReg(d, ir->r2);
+    if (ir->ty == IR_CALL) {
+        for (int i = 0; i < ir->NArgs; i++) markReg(d, IRArgs(d->fn, ir)[i]);
+    }
+}
+
+// Marks the arguments passed to the i-th parameter of bb.
+static void markArgs(DCE *d, BB *bb, int i) {
+    for (int j = 0; j < bb->Pred.len; j++) {
+        BB *pred = BBVecGet(&bb->Pred, j);
+        IR *ir = IRVecData(&pred->IRs) + pred->IRs.len - 1;
+        if (ir->ty == IR_JMP && ir->bb1 == bb) markReg(d, IRBBArgs(d->fn, ir)[i]);
+    }
+}
+
+static void mark(DCE *d) {
+    Function *fn = d->fn;
+    for (int k = 0; k < d->du->NSites; k++) {
+        if (hasEffect(SiteIR(&d->du->Sites[k])->ty)) markSite(d, k);
+    }
+
+    while (d->work.len) {
+        int r = IntVecPop(&d->work);
+        int k = d->du->Def[r];
+        if (k >= 0) markSite(d, k);
+        for (int i = 0; i < d->defs[r].len; i++) markSite(d, IntVecGet(&d->defs[r], i));
+
+        IntVec *params = &d->params[r];
+        for (int i = 0; i < params->len; i += 2) {
+            markArgs(d, BBVecGet(&fn->bbs, IntVecGet(params, i)), IntVecGet(params, i + 1));
+        }
+    }
+}
+
+// Drops the parameters of bb nothing reads and the arguments passed to
+// them. Returns whether there were any.
+static int sweepParams(DCE *d, BB *bb) {
+    Function *fn = d->fn;
+    IntVec *params = &bb->Params;
+    int n = 0;
+    for (int i = 0; i < params->len; i++) {
+        if (d->live[IntVecGet(params, i)]) n++;
+    }
+    if (n == params->len) return 0;
+
+    IntVec args = {0};
+    for (int i = 0; i < bb->Pred.len; i++) {
+        BB *pred = BBVecGet(&bb->Pred, i);
+        IR *ir = IRVecData(&pred->IRs) + pred->IRs.len - 1;
+        if (ir->ty != IR_JMP || ir->bb1 != bb) continue;
+        args.len = 0;
+        for (int i = 0; i < ir->NBBArgs; i++) {
+            if (d->live[IntVecGet(params, i)]) IntVecPush(&args, IRBBArgs(fn, ir)[i]);
+        }
+        SetBBArgs(fn, ir, IntVecData(&args), args.len);
+    }
+    IntVecFree(&args);
+
+    n = 0;
+    for (int i = 0; i < params->len; i++) {
+        int r = IntVecGet(params, i);
+        if (d->live[r]) IntVecSet(params, n++, r);
+    }
+    params->len = n;
+    return 1;
+}
+
+static int sweep(DCE *d) {
+    Function *fn = d->fn;
+    int changed = 0, k = 0;
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        IRCursor c;
+        IROpen(&c, bb);
+        for (IR *ir; (ir = IRCur(&c)); k++) {
+            if (d->marked[k]) {
+                IRNext(&c);
+            } else {
+                IRErase(&c);
+                changed = 1;
+            }
+        }
+        IRClose(&c);
+    }
+
+    // Jumps are always live, so the arguments are dropped only after
+    // the sweep has visited every block.
+    for (int i = 0; i < fn->bbs.len; i++) {
+        changed |= sweepParams(d, BBVecGet(&fn->bbs, i));
+    }
+    return changed;
+}
+
+// Removes the unreachable blocks and the dead instructions of fn.
+int EliminateDeadCode(Function *fn) {
+    Require(fn, ANALYSIS_CFG);
+    int changed = RemoveUnreachable(fn);
+
+    DCE d = {0};
+    d.fn = fn;
+    d.du = NewDefUse(fn);
+    d.defs = MemCalloc(MEM_OTHER, fn->NRegs + 1, sizeof(IntVec));
+    d.live = MemCalloc(MEM_OTHER, fn->NRegs + 1, 1);
+    d.params = MemCalloc(MEM_OTHER, fn->NRegs + 1, sizeof(IntVec));
+    d.marked = MemCalloc(MEM_OTHER, d.du->NSites + 1, 1);
+
+    for (int k = 0; k < d.du->NSites; k++) {
+        int r = SiteIR(&d.du->Sites[k])->r0;
+        if (r && d.du->Def[r] == DEF_MANY) IntVecPush(&d.defs[r], k);
+    }
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        for (int j = 0; j < bb->Params.len; j++) {
+            IntVec *params = &d.params[IntVecGet(&bb->Params, j)];
+            IntVecPush(params, i);
+            IntVecPush(params, j);
+        }
+    }
+
+    mark(&d);
+    changed |= sweep(&d);
+
+    for (int i = 0; i <= fn->NRegs; i++) {
+        IntVecFree(&d.defs[i]);
+        IntVecFree(&d.params[i]);
+    }
+    IntVecFree(&d.work);
+    MemFree(d.defs);
+    MemFree(d.params);
+    MemFree(d.live);
+    MemFree(d.marked);
+    FreeDefUse(d.du);
+    return changed;
+}
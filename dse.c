@@ -0,0 +1,191 @@
+// Dead store elimination.
+//
+// Only stores to locals that pointers from elsewhere and calls can't
+// reach are considered (see alias.c), so the loads that read such a
+// local are exactly those from addresses into it. A backward data flow
+// over the CFG finds the locals that may still be read after each
+// instruction:
+//
+//   Out(bb) = union of In(succ) over the successors of bb
+//   In(bb)  = Gen(bb) + (Out(bb) - Kill(bb))
+//
+// where Gen holds the locals a block loads from before storing all of
+// them, and Kill those it stores all of. A store to a local nothing
+// reads afterwards is dead, and so is a store whose address a later
+// store in the block writes with the same size before any load from
+// the local.
+#include "dse.h"
+#include "alias.h"
+#include "cfg.h"
+#include "mem.h"
+#include "pass.h"
+
+typedef struct DSE {
+    Function *fn;
+    DefUse *du;
+    AliasInfo *ai;
+    BitSet **gen, **kill, **in, **out; // per block, by reverse postorder number
+    char *live;                        // per local
+    char *dead;                        // per site
+    int removed;
+} DSE;
+
+// Returns the index of the local ir reads or writes if only accesses
+// to its address can, or -1.
+static int localOf(DSE *d, IR *ir) {
+    AliasInfo *ai = d->ai;
+    int addr = 0;
+    if (ir->ty == IR_STORE_ARG) {
+        if (!MayEscape(ai, BASE_LOCAL, ir->ID)) return LocalIndex(d->fn, ir->ID);
+        return -1;
+    }
+    if (ir->ty == IR_LOAD) addr = ir->r2;
+    if (ir->ty == IR_STORE) addr = ir->r1;
+    if (!addr || ai->Base[addr] != BASE_LOCAL || MayEscape(ai, BASE_LOCAL, ai->Obj[addr])) return -1;
+    return LocalIndex(d->fn, ai->Obj[addr]);
+}
+
+// Returns whether the store ir writes all of its local.
+static int storesAll(DSE *d, IR *ir) {
+    if (ir->ty == IR_STORE_ARG) return ir->Size == ir->ID->ty->Size;
+    int k = d->du->Def[ir->r1];
+    if (k < 0) return 0;
+    IR *def = SiteIR(&d->du->Sites[k]);
+    return def->ty == IR_BPREL && ir->Size == def->ID->ty->Size;
+}
+
+static int isStore(IRType ty) {
+    return ty == IR_STORE || ty == IR_STORE_ARG;
+}
+
+static void scanBB(DSE *d, BB *bb, BitSet *gen, BitSet *kill) {
+    for (int i = 0; i < bb->IRs.len; i++) {
+        IR *ir = IRVecData(&bb->IRs) + i;
+        int v = localOf(d, ir);
+        if (v < 0) continue;
+        if (ir->ty == IR_LOAD && !BitSetContain(kill, v)) BitSetAdd(gen, v);
+        if (isStore(ir->ty) && storesAll(d, ir)) BitSetAdd(kill, v);
+    }
+}
+
+static void solve(DSE *d) {
+    Function *fn = d->fn;
+    int n = fn->RPO.len;
+    for (int i = 0; i < n; i++) {
+        d->gen[i] = NewBitSet();
+        d->kill[i] = NewBitSet();
+        d->in[i] = NewBitSet();
+        d->out[i] = NewBitSet();
+        scanBB(d, BBVecGet(&fn->RPO, i), d->gen[i], d->kill[i]);
+    }
+
+    // The sets only grow; visiting blocks in postorder needs one more
+    // round per loop nesting level.
+    for (int changed = 1; changed;) {
+        changed = 0;
+        for (int i = n - 1; i >= 0; i--) {
+            BB *bb = BBVecGet(&fn->RPO, i);
+            for (int j = 0; j < bb->Succ.len; j++) {
+                BitSetUnion(d->out[i], d->in[BBVecGet(&bb->Succ, j)->RPO]);
+            }
+            changed |= BitSetUnion(d->in[i], d->gen[i]);
+            changed |= BitSetUnionDiff(d->in[i], d->out[i], d->kill[i]);
+        }
+    }
+}
+
+// Marks the dead stores of bb, walking it backwards from its end. k is
+// the site of its first instruction.
+static void markBB(DSE *d, BB *bb, BitSet *out, int k) {
+    int nlocals = VectorSize(d->fn->LocalVars);
+    for (int v = 0; v < nlocals; v++) d->live[v] = BitSetContain(out, v);
+
+    // Stores later in the block, with no load from their local since.
+    IntVec later = {0};
+    for (int i = bb->IRs.len - 1; i >= 0; i--) {
+        IR *ir = IRVecData(&bb->IRs) + i;
+        int v = localOf(d, ir);
+        if (v < 0) continue;
+
+        if (ir->ty == IR_LOAD) {
+            d->live[v] = 1;
+            int n = 0;
+            for (int j = 0; j < later.len; j++) {
+                IR *st = IRVecData(&bb->IRs) + IntVecGet(&later, j);
+                if (localOf(d, st) != v) IntVecSet(&later, n++, IntVecGet(&later, j));
+            }
+            later.len = n;
+            continue;
+        }
+
+        int overwritten = 0;
+        for (int j = 0; j < later.len && ir->ty == IR_STORE; j++) {
+            IR *st = IRVecData(&bb->IRs) + IntVecGet(&later, j);
+            overwritten |= st->ty == IR_STORE && st->r1 == ir->r1 && st->Size == ir->Size;
+        }
+        if (!d->live[v] || overwritten) {
+            d->dead[k + i] = 1;
+            d->removed++;
+        }
+        IntVecPush(&later, i);
+        if (storesAll(d, ir)) d->live[v] = 0;
+    }
+    IntVecFree(&later);
+}
+
+// Removes the stores of fn whose value is never loaded.
+int EliminateDeadStores(Function *fn) {
+    Require(fn, ANALYSIS_CFG);
+    int changed = RemoveUnreachable(fn);
+
+    DSE d = {0};
+    d.fn = fn;
+    d.du = NewDefUse(fn);
+    d.ai = NewAliasInfo(fn, d.du);
+    int n = fn->RPO.len;
+    d.gen = MemCalloc(MEM_OTHER, n, sizeof(BitSet *));
+    d.kill = MemCalloc(MEM_OTHER, n, sizeof(BitSet *));
+    d.in = MemCalloc(MEM_OTHER, n, sizeof(BitSet *));
+    d.out = MemCalloc(MEM_OTHER, n, sizeof(BitSet *));
+    d.live = MemCalloc(MEM_OTHER, VectorSize(fn->LocalVars) + 1, 1);
+    d.dead = MemCalloc(MEM_OTHER, d.du->NSites + 1, 1);
+    solve(&d);
+
+    // Sites number the instructions of fn->bbs in order.
+    int k = 0;
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        markBB(&d, bb, d.out[bb->RPO], k);
+        k += bb->IRs.len;
+    }
+
+    if (d.removed) {
+        k = 0;
+        for (int i = 0; i < fn->bbs.len; i++) {
+            BB *bb = BBVecGet(&fn->bbs, i);
+            IRCursor c;
+            IROpen(&c, bb);
+            for (; IRCur(&c); k++) {
+                if (d.dead[k]) IRErase(&c);
+                else IRNext(&c);
+            }
+            IRClose(&c);
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        BitSetFree(d.gen[i]);
+        BitSetFree(d.kill[i]);
+        BitSetFree(d.in[i]);
+        BitSetFree(d.out[i]);
+    }
+    MemFree(d.gen);
+    MemFree(d.kill);
+    MemFree(d.in);
+    MemFree(d.out);
+    MemFree(d.live);
+    MemFree(d.dead);
+    FreeAliasInfo(d.ai);
+    FreeDefUse(d.du);
+    return changed || d.removed;
+}
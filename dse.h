@@ -0,0 +1,8 @@
+#ifndef DSE_H
+#define DSE_H
+
+#include "ir.h"
+
+int EliminateDeadStores(Function *fn);
+
+#endif
@@ -1,10 +1,13 @@
 #include "gen_x86.h"
+#include "stats.h"
+#include "timer.h"
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <string.h>
 #define min(x,y) ((x) < (y) ? (x) : (y))
 
 // This pass generates x86-64 assembly from IR.
@@ -13,11 +16,13 @@ int roundup(int x, int align) {
     return (x + align - 1) & ~(align - 1);
 }
 
-char *regs[] = {"r10", "r11", "rbx", "r12", "r13", "r14", "r15"};
-char *regs8[] = {"r10b", "r11b", "bl", "r12b", "r13b", "r14b", "r15b"};
-char *regs32[] = {"r10d", "r11d", "ebx", "r12d", "r13d", "r14d", "r15d"};
+// The registers past num_regs are spares for spill code; r9 is only
+// written while setting up a call otherwise.
+char *regs[] = {"r10", "r11", "rbx", "r12", "r13", "r14", "r15", "r9"};
+char *regs8[] = {"r10b", "r11b", "bl", "r12b", "r13b", "r14b", "r15b", "r9b"};
+char *regs32[] = {"r10d", "r11d", "ebx", "r12d", "r13d", "r14d", "r15d", "r9d"};
 
-int num_regs = sizeof(regs) / sizeof(*regs);
+int num_regs = sizeof(regs) / sizeof(*regs) - 1;
 
 char *argregs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
 char *argregs8[] = {"dil", "sil", "dl", "cl", "r8b", "r9b"};
@@ -33,7 +38,14 @@ void p(char *fmt, ...) {
     printf("\n");
 }
 
+static int nEmitted; // instructions emitted so far
+
+// Whether to emit .loc directives, and the line of the last one.
+static int lineTable;
+static int lastLine;
+
 void emit(char *fmt, ...) {
+    nEmitted++;
     va_list ap;
     va_start(ap, fmt);
     printf("\t");
@@ -41,10 +53,18 @@ void emit(char *fmt, ...) {
     printf("\n");
 }
 
-void emit_cmp(char *insn, IR *ir) {
-    int r0 = ir->r0->RealNum;
-    int r1 = ir->r1->RealNum;
-    int r2 = ir->r2->RealNum;
+// Starts a line table row for line, unless it is unknown (0) or the
+// current row already covers it.
+void emit_loc(int line) {
+    if (!lineTable || !line || line == lastLine) return;
+    p("\t.loc 1 %d", line);
+    lastLine = line;
+}
+
+void emit_cmp(Function *fn, char *insn, IR *ir) {
+    int r0 = GetReg(fn, ir->r0)->RealNum;
+    int r1 = GetReg(fn, ir->r1)->RealNum;
+    int r2 = GetReg(fn, ir->r2)->RealNum;
 
     emit("cmp %s, %s", regs[r1], regs[r2]);
     emit("%s %s", insn, regs8[r0]);
@@ -69,14 +89,16 @@ char *argreg(int r, int size) {
     return argregs[r];
 }
 
-void emit_ir(IR *ir, char *ret) {
-    int r0 = ir->r0 ? ir->r0->RealNum : 0;
-    int r1 = ir->r1 ? ir->r1->RealNum : 0;
-    int r2 = ir->r2 ? ir->r2->RealNum : 0;
+// Emits ir; next is the block laid out after it, which jumps there
+// fall through to, or NULL, in which case ret is next.
+void emit_ir(Function *fn, IR *ir, char *ret, BB *next) {
+    int r0 = ir->r0 ? GetReg(fn, ir->r0)->RealNum : 0;
+    int r1 = ir->r1 ? GetReg(fn, ir->r1)->RealNum : 0;
+    int r2 = ir->r2 ? GetReg(fn, ir->r2)->RealNum : 0;
 
     switch (ir->ty) {
     case IR_IMM:
-        emit("mov %s, %u", regs[r0], ir->imm);
+        emit("mov %s, %d", regs[r0], ir->imm);
         break;
     case IR_BPREL:
         emit("lea %s, [rbp%d]", regs[r0], ir->ID->Offset);
@@ -86,11 +108,18 @@ void emit_ir(IR *ir, char *ret) {
         break;
     case IR_RETURN:
         emit("mov rax, %s", regs[r2]);
-        emit("jmp %s", ret);
+        if (next) emit("jmp %s", ret);
         break;
     case IR_CALL:
-        for (int i = 0; i < ir->NArgs; i++)
-            emit("mov %s, %s", argregs[i], regs[ir->Args[i]->RealNum]);
+        // Spilled arguments are loaded straight from their slots, as
+        // they can't all share the register reserved for spills.
+        for (int i = 0; i < ir->NArgs; i++) {
+            Reg *arg = GetReg(fn, IRArgs(fn, ir)[i]);
+            if (arg->Spill)
+                emit("mov %s, [rbp%d]", argregs[i], arg->ID->Offset);
+            else
+                emit("mov %s, %s", argregs[i], regs[arg->RealNum]);
+        }
 
         emit("push r10");
         emit("push r11");
@@ -104,16 +133,16 @@ void emit_ir(IR *ir, char *ret) {
         emit("lea %s, %s", regs[r0], ir->Name);
         break;
     case IR_EQ:
-        emit_cmp("sete", ir);
+        emit_cmp(fn, "sete", ir);
         break;
     case IR_NE:
-        emit_cmp("setne", ir);
+        emit_cmp(fn, "setne", ir);
         break;
     case IR_LT:
-        emit_cmp("setl", ir);
+        emit_cmp(fn, "setl", ir);
         break;
     case IR_LE:
-        emit_cmp("setle", ir);
+        emit_cmp(fn, "setle", ir);
         break;
     case IR_AND:
         emit("and %s, %s", regs[r0], regs[r2]);
@@ -133,17 +162,24 @@ void emit_ir(IR *ir, char *ret) {
         emit("shr %s, cl", regs[r0]);
         break;
     case IR_JMP:
-        if (ir->bbArg) {
-            emit("mov %s, %s", regs[ir->bb1->Param->RealNum], regs[ir->bbArg->RealNum]);
-        }
-        emit("jmp .L%d", ir->bb1->Label);
+        assert(!ir->NBBArgs && "jmp arguments left after leaving SSA");
+        if (ir->bb1 != next) emit("jmp .L%d", ir->bb1->Label);
         break;
     case IR_TEST:
         emit("cmp %s, 0", regs[r2]);
+        if (ir->bb1 == next) {
+            emit("je .L%d", ir->bb2->Label);
+            break;
+        }
         emit("jne .L%d", ir->bb1->Label);
-        emit("jmp .L%d", ir->bb2->Label);
+        if (ir->bb2 != next) emit("jmp .L%d", ir->bb2->Label);
         break;
     case IR_LOAD:
+        if (ir->Size == 4) {
+            // ints are kept sign-extended to 64 bits in registers.
+            emit("movsxd %s, dword ptr [%s]", regs[r0], regs[r2]);
+            break;
+        }
         emit("mov %s, [%s]", reg(r0, ir->Size), regs[r2]);
         if (ir->Size == 1) {
             emit("movzb %s, %s", regs[r0], regs8[r0]);
@@ -152,6 +188,14 @@ void emit_ir(IR *ir, char *ret) {
     case IR_LOAD_SPILL:
         emit("mov %s, [rbp%d]", regs[r0], ir->ID->Offset);
         break;
+    case IR_LOAD_ARG:
+        if (ir->Size == 4)
+            emit("movsxd %s, %s", regs[r0], argregs32[ir->imm]);
+        else if (ir->Size == 1)
+            emit("movzb %s, %s", regs[r0], argregs8[ir->imm]);
+        else
+            emit("mov %s, %s", regs[r0], argregs[ir->imm]);
+        break;
     case IR_STORE:
         emit("mov [%s], %s", regs[r1], reg(r2, ir->Size));
         break;
@@ -184,6 +228,9 @@ void emit_ir(IR *ir, char *ret) {
         emit("idiv %s", regs[r2]);
         emit("mov %s, rdx", regs[r0]);
         break;
+    case IR_NEG:
+        emit("neg %s", regs[r0]);
+        break;
     case IR_NOP:
         break;
     default:
@@ -203,25 +250,47 @@ void emit_code(Function *fn) {
     }
 
     // Emit assembly
+    int emitted = nEmitted;
     char *ret = Format(".Lend%d", nLabel++);
 
+    int frame = roundup(off, 16);
+    lastLine = 0;
+
     p(".text");
     p(".global %s", fn->Name);
+    p(".type %s, @function", fn->Name);
     p("%s:", fn->Name);
+    p("\t.cfi_startproc");
+    emit_loc(fn->Line);
+
+    // The CFA is rsp before the call, i.e. rbp + 16 once rbp is set
+    // up; callee-saved registers are pushed below the locals and 8
+    // bytes of padding that keep rsp 16-byte aligned.
     emit("push rbp");
+    p("\t.cfi_def_cfa_offset 16");
+    p("\t.cfi_offset rbp, -16");
     emit("mov rbp, rsp");
-    emit("sub rsp, %d", roundup(off, 16));
+    p("\t.cfi_def_cfa_register rbp");
+    emit("sub rsp, %d", frame + 8);
+    emit("push rbx");
     emit("push r12");
     emit("push r13");
     emit("push r14");
     emit("push r15");
+    p("\t.cfi_offset rbx, %d", -(frame + 32));
+    p("\t.cfi_offset r12, %d", -(frame + 40));
+    p("\t.cfi_offset r13, %d", -(frame + 48));
+    p("\t.cfi_offset r14, %d", -(frame + 56));
+    p("\t.cfi_offset r15, %d", -(frame + 64));
 
-    for (int i = 0; i < VectorSize(fn->bbs); i++) {
-        BB *bb = VectorGet(fn->bbs, i);
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        BB *next = i + 1 < fn->bbs.len ? BBVecGet(&fn->bbs, i + 1) : NULL;
         p(".L%d:", bb->Label);
-        for (int i = 0; i < VectorSize(bb->IRs); i++) {
-            IR *ir = VectorGet(bb->IRs, i);
-            emit_ir(ir, ret);
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            emit_loc(ir->Line);
+            emit_ir(fn, ir, ret, next);
         }
     }
 
@@ -230,9 +299,18 @@ void emit_code(Function *fn) {
     emit("pop r14");
     emit("pop r13");
     emit("pop r12");
+    emit("pop rbx");
     emit("mov rsp, rbp");
     emit("pop rbp");
+    p("\t.cfi_def_cfa rsp, 8");
     emit("ret");
+    p("\t.cfi_endproc");
+    p(".size %s, .-%s", fn->Name, fn->Name);
+
+    if (StatsEnabled) {
+        GetStats(fn)->FrameSize = frame;
+        GetStats(fn)->AsmInsts = nEmitted - emitted;
+    }
 }
 
 char *backslash_escape(char *s, int len) {
@@ -264,15 +342,21 @@ char *backslash_escape(char *s, int len) {
     return StringBuilderToString(sb);
 }
 
+void emit_label(Var *ID) {
+    p(".type %s, @object", ID->Name);
+    p(".size %s, %d", ID->Name, ID->ty->Size);
+    p("%s:", ID->Name);
+}
+
 void emit_data(Var *ID) {
     if (ID->StringData) {
         p(".data");
-        p("%s:", ID->Name);
+        emit_label(ID);
         emit(".ascii \"%s\"", backslash_escape(ID->StringData, ID->ty->Size));
         return;
     } else if (ID->RawData) {
         p(".data");
-        p("%s:", ID->Name);
+        emit_label(ID);
         int size = ID->ty->Size;
         int i = 0;
         while (i < size && i < ID->RawDataSize) {
@@ -288,16 +372,28 @@ void emit_data(Var *ID) {
     }
 
     p(".bss");
-    p("%s:", ID->Name);
+    emit_label(ID);
     emit(".zero %d", ID->ty->Size);
 }
 
 void Genx86(Program *prog) {
     p(".intel_syntax noprefix");
 
+    // Source lines go into a DWARF line table through .file and .loc;
+    // IR read back from a file only has them if it names its source.
+    lineTable = prog->File != NULL;
+    if (lineTable)
+        p(".file 1 \"%s\"", backslash_escape(prog->File, strlen(prog->File)));
+
+    TimerBegin(PHASE_GENX86);
     for (int i = 0; i < VectorSize(prog->GlobalVars); i++)
         emit_data(VectorGet(prog->GlobalVars, i));
+    TimerEnd(NULL);
 
-    for (int i = 0; i < prog->Functions->len; i++)
-        emit_code(VectorGet(prog->Functions, i));
+    for (int i = 0; i < prog->Functions->len; i++) {
+        Function *fn = VectorGet(prog->Functions, i);
+        TimerBegin(PHASE_GENX86);
+        emit_code(fn);
+        TimerEnd(fn->Name);
+    }
 }
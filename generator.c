@@ -1,42 +1,36 @@
 #include "generator.h"
+#include "mem.h"
+#include "stats.h"
+#include "timer.h"
 #include "stdlib.h"
 #include <assert.h>
 #include <string.h>
 
 Function *fn;
 BB *out;
-int nreg = 1;
+static int line; // source line of the code being generated
 
 void genStmt(Statement *stmt);
 
 BB *NewBB() {
-    BB *bb = calloc(1, sizeof(BB));
+    BB *bb = MemCalloc(MEM_BB, 1, sizeof(BB));
     bb->Label = nLabel++;
-    bb->IRs = NewVector();
-    bb->Succ = NewVector();
-    bb->Pred = NewVector();
-    bb->DefRegs = NewVector();
-    bb->InRegs = NewVector();
-    bb->OutRegs = NewVector();
-    VectorPush(fn->bbs, bb);
+    BBVecPush(&fn->bbs, bb);
     return bb;
 }
 
+// Appends an instruction to the current block. The result points into
+// the block's array, so it is only valid until the next NewIR.
 IR *NewIR(IRType ty) {
-    IR *ir = calloc(1, sizeof(IR));
-    ir->ty = ty;
-    VectorPush(out->IRs, ir);
-    return ir;
+    IRVecPush(&out->IRs, (IR){.ty = ty, .Line = line});
+    return IRVecData(&out->IRs) + out->IRs.len - 1;
 }
 
-Reg *NewReg() {
-    Reg *r = calloc(1, sizeof(Reg));
-    r->VirtualNum = nreg++;
-    r->RealNum = -1;
-    return r;
+int NewReg() {
+    return AddReg(fn);
 }
 
-IR *emitIR(IRType ty, Reg *r0, Reg *r1, Reg *r2) {
+IR *emitIR(IRType ty, int r0, int r1, int r2) {
     IR *ir = NewIR(ty);
     ir->r0 = r0;
     ir->r1 = r1;
@@ -44,7 +38,7 @@ IR *emitIR(IRType ty, Reg *r0, Reg *r1, Reg *r2) {
     return ir;
 }
 
-IR *emitBR(Reg *r, BB *then, BB *els) {
+IR *emitBR(int r, BB *then, BB *els) {
     IR *ir = NewIR(IR_TEST);
     ir->r2 = r;
     ir->bb1 = then;
@@ -58,25 +52,32 @@ IR *emitJmp(BB *bb) {
     return ir;
 }
 
-IR *emitJmpArg(BB *bb, Reg *r) {
+IR *emitJmpArg(BB *bb, int r) {
     IR *ir = NewIR(IR_JMP);
     ir->bb1 = bb;
-    ir->bbArg = r;
+    SetBBArgs(fn, ir, &r, 1);
     return ir;
 }
 
-Reg *emitImm(int imm) {
-    Reg *r = NewReg();
+// Gives the current block a parameter and returns it.
+int addParam() {
+    int r = NewReg();
+    IntVecPush(&out->Params, r);
+    return r;
+}
+
+int emitImm(int imm) {
+    int r = NewReg();
     IR *ir = NewIR(IR_IMM);
     ir->r0 = r;
     ir->imm = imm;
     return r;
 }
 
-Reg *genExp(Expression *exp);
+int genExp(Expression *exp);
 
-void emitLoad(Expression *exp, Reg *dst, Reg *src) {
-    IR *ir = emitIR(IR_LOAD, dst, NULL, src);
+void emitLoad(Expression *exp, int dst, int src) {
+    IR *ir = emitIR(IR_LOAD, dst, 0, src);
     ir->Size = exp->ctype->Size;
 }
 
@@ -97,15 +98,15 @@ void emitLoad(Expression *exp, Reg *dst, Reg *src) {
 // conversion.
 //
 // This function evaluates a given exp as an lvalue.
-Reg *genLeftValue(Expression *exp) {
+int genLeftValue(Expression *exp) {
     if (exp->ty == EXP_DEREF) {
         return genExp(exp->Exp1);
     }
 
     if (exp->ty == EXP_ACCSESS) {
-        Reg *r1 = NewReg();
-        Reg *r2 = genLeftValue(exp->Exp1);
-        Reg *r3 = emitImm(exp->ctype->offset);
+        int r1 = NewReg();
+        int r2 = genLeftValue(exp->Exp1);
+        int r3 = emitImm(exp->ctype->offset);
         emitIR(IR_ADD, r1, r2, r3);
         return r1;
     }
@@ -129,9 +130,9 @@ Reg *genLeftValue(Expression *exp) {
     assert(0 && "illegal leftvalue");
 }
 
-Reg *genUnop(Expression *exp) {
-    Reg *r1 = NewReg();
-    Reg *r2 = genExp(exp->Exp1);
+int genUnop(Expression *exp) {
+    int r1 = NewReg();
+    int r2 = genExp(exp->Exp1);
     switch (exp->Op->Type) {
     case TOKEN_OP_NOT:
         emitIR(IR_EQ, r1, r2, emitImm(0));
@@ -142,10 +143,10 @@ Reg *genUnop(Expression *exp) {
     }
 }
 
-Reg *genBinop(Expression *exp) {
-    Reg *r1 = NewReg();
-    Reg *r2 = genExp(exp->Exp1);
-    Reg *r3 = genExp(exp->Exp2);
+int genBinop(Expression *exp) {
+    int r1 = NewReg();
+    int r2 = genExp(exp->Exp1);
+    int r3 = genExp(exp->Exp2);
 
     IRType ty = GetIRType(exp->Op->Type);
     assert(ty != IR_ILLEGAL && "unexpected operator");
@@ -153,7 +154,7 @@ Reg *genBinop(Expression *exp) {
     return r1;
 }
 
-Reg *genMultiop(Expression *exp) {
+int genMultiop(Expression *exp) {
     switch (exp->Op->Type) {
     case TOKEN_OP_AND: {
         BB *bb = NewBB();
@@ -177,8 +178,7 @@ Reg *genMultiop(Expression *exp) {
         emitJmpArg(last, emitImm(1));
 
         out = last;
-        out->Param = NewReg();
-        return out->Param;
+        return addParam();
     }
     case TOKEN_OP_OR: {
         BB *bb = NewBB();
@@ -202,8 +202,7 @@ Reg *genMultiop(Expression *exp) {
         emitJmpArg(last, emitImm(1));
 
         out = last;
-        out->Param = NewReg();
-        return out->Param;
+        return addParam();
     }
     case TOKEN_SEP_COMMA:
         for (int i = 0; i < VectorSize(exp->Exps) - 1; i++) {
@@ -214,7 +213,7 @@ Reg *genMultiop(Expression *exp) {
     assert(0 && "illegal multiop");
 }
 
-Reg *genExp(Expression *exp) {
+int genExpr(Expression *exp) {
     switch (exp->ty) {
     case EXP_INT:
     case EXP_CHAR:
@@ -227,12 +226,12 @@ Reg *genExp(Expression *exp) {
         return genMultiop(exp);
     case EXP_VARREF:
     case EXP_ACCSESS: {
-        Reg *r = NewReg();
+        int r = NewReg();
         emitLoad(exp, r, genLeftValue(exp));
         return r;
     }
     case EXP_FUNCCALL: {
-        Reg *args[6];
+        int args[6];
         for (int i = 0; i < VectorSize(exp->Exps); i++) {
             args[i] = genExp(VectorGet(exp->Exps, i));
         }
@@ -240,22 +239,25 @@ Reg *genExp(Expression *exp) {
         IR *ir = NewIR(IR_CALL);
         ir->r0 = NewReg();
         ir->Name = exp->Name;
+        ir->Args = fn->Args.len;
         ir->NArgs = VectorSize(exp->Exps);
-        memcpy(ir->Args, args, sizeof(args));
+        for (int i = 0; i < ir->NArgs; i++) {
+            IntVecPush(&fn->Args, args[i]);
+        }
         return ir->r0;
     }
     case EXP_ADDR:
         return genLeftValue(exp->Exp1);
     case EXP_DEREF: {
-        Reg *r = NewReg();
+        int r = NewReg();
         emitLoad(exp, r, genExp(exp->Exp1));
         return r;
     }
     // case EXP_CAST: {
-    //     Reg *r1 = genExp(exp->expr);
+    //     int r1 = genExp(exp->expr);
     //     if (exp->ty->ty != BOOL)
     //         return r1;
-    //     Reg *r2 = newReg();
+    //     int r2 = newReg();
     //     emitIR(IR_NE, r2, r1, emitImm(0));
     //     return r2;
     // }
@@ -264,10 +266,10 @@ Reg *genExp(Expression *exp) {
             genStmt(VectorGet(exp->Stmts, i));
         return genExp(exp->Exp1);
     case EXP_ASSIGN: {
-        Reg *r1 = genExp(exp->Exp2);
-        Reg *r2 = genLeftValue(exp->Exp1);
+        int r1 = genExp(exp->Exp2);
+        int r2 = genLeftValue(exp->Exp1);
 
-        IR *ir = emitIR(IR_STORE, NULL, r2, r1);
+        IR *ir = emitIR(IR_STORE, 0, r2, r1);
         ir->Size = exp->ctype->Size;
         return r1;
     }
@@ -285,15 +287,29 @@ Reg *genExp(Expression *exp) {
         emitJmpArg(last, genExp(exp->Exp2));
 
         out = last;
-        out->Param = NewReg();
-        return out->Param;
+        return addParam();
     }
     default:
         assert(0 && "unknown AST type");
     }
 }
 
+// Generates exp, tagging its instructions with the line of its
+// operator token.
+int genExp(Expression *exp) {
+    int saved = line;
+    if (exp->Op) line = exp->Op->Line;
+    int r = genExpr(exp);
+    line = saved;
+    return r;
+}
+
 void genStmt(Statement *stmt) {
+    // The jumps of a statement get the line of the expression it tests
+    // or evaluates.
+    Expression *exp = stmt->Cond ? stmt->Cond : stmt->Exp;
+    if (exp && exp->Op) line = exp->Op->Line;
+
     switch (stmt->ty) {
     case STMT_NULL:
         return;
@@ -326,7 +342,7 @@ void genStmt(Statement *stmt) {
 
         out = cond;
         if (stmt->Cond) {
-            Reg *r = genExp(stmt->Cond);
+            int r = genExp(stmt->Cond);
             emitBR(r, body, stmt->Break);
         } else {
             emitJmp(body);
@@ -355,7 +371,7 @@ void genStmt(Statement *stmt) {
         emitJmp(stmt->Continue);
 
         out = stmt->Continue;
-        Reg *r = genExp(stmt->Cond);
+        int r = genExp(stmt->Cond);
         emitBR(r, body, stmt->Break);
 
         out = stmt->Break;
@@ -365,13 +381,13 @@ void genStmt(Statement *stmt) {
         stmt->Break = NewBB();
         stmt->Continue = NewBB();
 
-        Reg *r = genExp(stmt->Cond);
+        int r = genExp(stmt->Cond);
         for (int i = 0; i < VectorSize(stmt->Cases); i++) {
             Statement *Case = VectorGet(stmt->Cases, i);
             Case->bb = NewBB();
 
             BB *next = NewBB();
-            Reg *r2 = NewReg();
+            int r2 = NewReg();
             if (!Case->Default) {
                 emitIR(IR_EQ, r2, r, emitImm(Case->Cond->Val));
                 emitBR(r2, Case->bb, next);
@@ -402,7 +418,7 @@ void genStmt(Statement *stmt) {
         out = NewBB();
         break;
     case STMT_RETURN: {
-        Reg *r = genExp(stmt->Exp);
+        int r = genExp(stmt->Exp);
         IR *ir = NewIR(IR_RETURN);
         ir->r2 = r;
         out = NewBB();
@@ -425,56 +441,13 @@ void genParam(Var *var, int i) {
     ir->ID = var;
     ir->imm = i;
     ir->Size = var->ty->Size;
-    var->AddressTaken = 1;
-}
-
-// Rewrite
-//
-//  BPREL r1, <offset>
-//  STORE r1, r2
-//  LOAD  r3, r1
-//
-// to
-//
-//  NOP
-//  r4 = r2
-//  r3 = r4
-void optimizeGen(IR *ir) {
-    if (ir->ty == IR_BPREL) {
-        Var *var = ir->ID;
-        if (var->AddressTaken || var->ty->ty != INT)
-            return;
-
-        if (!var->Promoted) {
-            var->Promoted = NewReg();
-        }
-
-        ir->ty = IR_NOP;
-        ir->r0->Promoted = var->Promoted;
-        return;
-    }
-
-    if (ir->ty == IR_LOAD) {
-        if (!ir->r2->Promoted)
-            return;
-        ir->ty = IR_MOV;
-        ir->r2 = ir->r2->Promoted;
-        return;
-    }
-
-    if (ir->ty == IR_STORE) {
-        if (!ir->r1->Promoted)
-            return;
-        ir->ty = IR_MOV;
-        ir->r0 = ir->r1->Promoted;
-        ir->r1 = NULL;
-        return;
-    }
 }
 
 void GenProgram(Program *program) {
     for (int i = 0; i < VectorSize(program->Functions); i++) {
         fn = VectorGet(program->Functions, i);
+        line = fn->Line;
+        TimerBegin(PHASE_IRGEN);
 
         // Add an empty entry BB to make later analysis easy.
         out = NewBB();
@@ -491,16 +464,12 @@ void GenProgram(Program *program) {
         genStmt(fn->Stmt);
 
         // Make it always ends with a return to make later analysis easy.
-        NewIR(IR_RETURN)->r2 = emitImm(0);
+        int r = emitImm(0);
+        NewIR(IR_RETURN)->r2 = r;
 
         // Later passes shouldn't need the AST, so make it explicit.
         fn->Stmt = NULL;
-
-        for (int i = 0; i < VectorSize(fn->bbs); i++) {
-            BB *bb = VectorGet(fn->bbs, i);
-            for (int i = 0; i < VectorSize(bb->IRs); i++) {
-                optimizeGen(VectorGet(bb->IRs, i));
-            }
-        }
+        StatsStageEnd(fn, "irgen");
+        TimerEnd(fn->Name);
     }
 }
@@ -0,0 +1,211 @@
+// Global value numbering.
+//
+// A walk of the dominator tree in preorder keeps a table of the pure
+// instructions seen on the path from the entry: immediates, addresses
+// of locals and globals, arithmetic and comparisons. An instruction
+// computing what the table already has, with the same operands after
+// renaming, is redundant: it is removed, and its result is replaced
+// everywhere by that of the instruction in the table, which dominates
+// all its uses. Copies are replaced by their source the same way.
+// Entries added in a block are dropped when the walk leaves the
+// subtree of the block.
+//
+// Registers defined more than once are not in SSA form, so they are
+// neither replaced nor looked up.
+#include <string.h>
+#include "gvn.h"
+#include "cfg.h"
+#include "mem.h"
+#include "pass.h"
+
+typedef struct Value {
+    IR key;   // with operands renamed, commutative ones in order
+    int reg;  // the register holding the value
+    int next; // the next value in the same bucket, or -1
+} Value;
+
+DEFINE_STRUCT_VEC(ValueVec, Value, MEM_OTHER)
+
+typedef struct GVN {
+    Function *fn;
+    DefUse *du;
+    int *subst;     // per register: the register replacing it, or 0
+    int *buckets;   // the last value in each bucket, or -1
+    int nbuckets;   // a power of two
+    ValueVec values; // a stack, in the order they were added
+    int removed;
+} GVN;
+
+static int isPure(IRType ty) {
+    switch (ty) {
+    case IR_IMM:
+    case IR_BPREL:
+    case IR_LABEL_ADDR:
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_MOD:
+    case IR_AND:
+    case IR_OR:
+    case IR_XOR:
+    case IR_SHL:
+    case IR_SHR:
+    case IR_EQ:
+    case IR_NE:
+    case IR_LE:
+    case IR_LT:
+    case IR_NEG:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int isCommutative(IRType ty) {
+    return ty == IR_ADD || ty == IR_MUL || ty == IR_AND || ty == IR_OR ||
+           ty == IR_XOR || ty == IR_EQ || ty == IR_NE;
+}
+
+static unsigned hash(IR *key) {
+    unsigned h = key->ty * 31u + key->r1;
+    h = h * 31u + key->r2;
+    if (key->ty == IR_IMM) h = h * 31u + key->imm;
+    if (key->ty == IR_BPREL) h = h * 31u + (unsigned)(size_t)key->ID;
+    if (key->ty == IR_LABEL_ADDR) {
+        for (char *s = key->Name; *s; s++) h = h * 31u + *s;
+    }
+    return h * 2654435761u;
+}
+
+static int equal(IR *a, IR *b) {
+    if (a->ty != b->ty || a->r1 != b->r1 || a->r2 != b->r2) return 0;
+    switch (a->ty) {
+    case IR_IMM:
+        return a->imm == b->imm;
+    case IR_BPREL:
+        return a->ID == b->ID;
+    case IR_LABEL_ADDR:
+        return !strcmp(a->Name, b->Name);
+    default:
+        return 1;
+    }
+}
+
+static int rename(GVN *g, int r) {
+    return g->subst[r] ? g->subst[r] : r;
+}
+
+static int isSSA(GVN *g, int r) {
+    return g->du->Def[r] != DEF_MANY;
+}
+
+// Returns the register already holding the value ir computes, or adds
+// ir to the table and returns 0.
+static int lookup(GVN *g, IR *ir) {
+    IR key = {.ty = ir->ty, .r1 = ir->r1, .r2 = ir->r2};
+    if (ir->ty == IR_IMM) key.imm = ir->imm;
+    if (ir->ty == IR_BPREL) key.ID = ir->ID;
+    if (ir->ty == IR_LABEL_ADDR) key.Name = ir->Name;
+    if (isCommutative(key.ty) && key.r1 > key.r2) {
+        key.r1 = ir->r2;
+        key.r2 = ir->r1;
+    }
+
+    unsigned b = hash(&key) & (g->nbuckets - 1);
+    for (int i = g->buckets[b]; i >= 0; i = ValueVecData(&g->values)[i].next) {
+        Value *v = ValueVecData(&g->values) + i;
+        if (equal(&v->key, &key)) return v->reg;
+    }
+    ValueVecPush(&g->values, (Value){key, ir->r0, g->buckets[b]});
+    g->buckets[b] = g->values.len - 1;
+    return 0;
+}
+
+// Drops the values added after the first n.
+static void popValues(GVN *g, int n) {
+    while (g->values.len > n) {
+        Value v = ValueVecPop(&g->values);
+        g->buckets[hash(&v.key) & (g->nbuckets - 1)] = v.next;
+    }
+}
+
+static void numberBB(GVN *g, BB *bb) {
+    Function *fn = g->fn;
+    IRCursor c;
+    IROpen(&c, bb);
+    for (IR *ir; (ir = IRCur(&c));) {
+        if (ir->r1) ir->r1 = rename(g, ir->r1);
+        if (ir->r2) ir->r2 = rename(g, ir->r2);
+        if (ir->ty == IR_CALL) {
+            for (int i = 0; i < ir->NArgs; i++) IRArgs(fn, ir)[i] = rename(g, IRArgs(fn, ir)[i]);
+        }
+        if (ir->ty == IR_JMP) {
+            for (int i = 0; i < ir->NBBArgs; i++) IRBBArgs(fn, ir)[i] = rename(g, IRBBArgs(fn, ir)[i]);
+        }
+
+        int r0 = ir->r0;
+        if (r0 && isSSA(g, r0) && (!ir->r1 || isSSA(g, ir->r1)) && (!ir->r2 || isSSA(g, ir->r2))) {
+            int same = 0;
+            if (ir->ty == IR_MOV) same = ir->r2;
+            else if (isPure(ir->ty)) same = lookup(g, ir);
+            if (same) {
+                g->subst[r0] = same;
+                g->removed++;
+                IRErase(&c);
+                continue;
+            }
+        }
+        IRNext(&c);
+    }
+    IRClose(&c);
+}
+
+// Numbers the values of fn and removes the redundant instructions.
+int NumberValues(Function *fn) {
+    Require(fn, ANALYSIS_DOMINATORS);
+    int changed = RemoveUnreachable(fn);
+
+    GVN g = {0};
+    g.fn = fn;
+    g.du = NewDefUse(fn);
+    g.subst = MemCalloc(MEM_OTHER, fn->NRegs + 1, sizeof(int));
+    g.nbuckets = 16;
+    while (g.nbuckets < g.du->NSites) g.nbuckets *= 2;
+    g.buckets = MemMalloc(MEM_OTHER, sizeof(int) * g.nbuckets);
+    for (int i = 0; i < g.nbuckets; i++) g.buckets[i] = -1;
+
+    int n = fn->RPO.len;
+    BB **stack = MemMalloc(MEM_OTHER, sizeof(BB *) * n);
+    int *next = MemMalloc(MEM_OTHER, sizeof(int) * n);
+    int *mark = MemMalloc(MEM_OTHER, sizeof(int) * n);
+    int top = 0;
+
+    BB *ent = BBVecGet(&fn->RPO, 0);
+    stack[top] = ent;
+    next[top] = 0;
+    mark[top++] = 0;
+    numberBB(&g, ent);
+
+    while (top > 0) {
+        BB *bb = stack[top - 1];
+        if (next[top - 1] < bb->DomChildren.len) {
+            BB *child = BBVecGet(&bb->DomChildren, next[top - 1]++);
+            stack[top] = child;
+            next[top] = 0;
+            mark[top++] = g.values.len;
+            numberBB(&g, child);
+            continue;
+        }
+        popValues(&g, mark[--top]);
+    }
+
+    MemFree(stack);
+    MemFree(next);
+    MemFree(mark);
+    ValueVecFree(&g.values);
+    MemFree(g.buckets);
+    MemFree(g.subst);
+    FreeDefUse(g.du);
+    return changed || g.removed > 0;
+}
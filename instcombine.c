@@ -0,0 +1,309 @@
+// Instruction combining.
+//
+// Simplifies instructions by algebraic identities, looking through
+// moves at the instructions defining their operands:
+//
+//   x+0, x-0, x|0, x^0, x*1, x/1, x&-1, x<<0, x>>0  =>  x
+//   x*0, x&0, x%1, x-x, x^x                          =>  0
+//   0-x                                              =>  neg x
+//   neg neg x, ~~x                                   =>  x
+//   !!x, i.e. (x==0)==0                              =>  x!=0
+//
+// Operations on constants are folded, and the constant operand of a
+// commutative operation is moved to the right, where the other rules
+// look for it. Instructions are only rewritten in place, so the
+// def-use chains stay valid; whenever one changes, the users of its
+// result are revisited, until nothing changes any more.
+#include "instcombine.h"
+#include "mem.h"
+#include <limits.h>
+
+typedef struct Combiner {
+    Function *fn;
+    DefUse *du;
+    IntVec work; // sites to visit
+    char *queued; // per site
+} Combiner;
+
+static void push(Combiner *c, int k) {
+    if (c->queued[k]) return;
+    c->queued[k] = 1;
+    IntVecPush(&c->work, k);
+}
+
+static void pushUsers(Combiner *c, int r) {
+    IntVec *users = &c->du->Users[r];
+    for (int i = 0; i < users->len; i++) push(c, IntVecGet(users, i));
+}
+
+// Returns the instruction defining r, or NULL if r is a parameter or
+// not in SSA form.
+static IR *defOf(Combiner *c, int r) {
+    int k = c->du->Def[r];
+    return k >= 0 ? SiteIR(&c->du->Sites[k]) : NULL;
+}
+
+// Returns the register whose value r holds, following moves. Only
+// registers in SSA form hold the same value wherever they are read.
+static int root(Combiner *c, int r) {
+    for (int n = 0; n < c->du->NSites; n++) {
+        IR *def = defOf(c, r);
+        if (!def || def->ty != IR_MOV || c->du->Def[def->r2] == DEF_MANY) break;
+        r = def->r2;
+    }
+    return r;
+}
+
+static int isConst(Combiner *c, int r, long long *val) {
+    IR *def = defOf(c, root(c, r));
+    if (!def || def->ty != IR_IMM) return 0;
+    *val = def->imm;
+    return 1;
+}
+
+// Returns the instruction defining the value of r if it is of type ty.
+static IR *defOfType(Combiner *c, int r, IRType ty) {
+    IR *def = defOf(c, root(c, r));
+    return def && def->ty == ty ? def : NULL;
+}
+
+// Makes the instruction at site k read r.
+static void use(Combiner *c, int k, int r) {
+    IntVecPush(&c->du->Users[r], k);
+}
+
+static void toMov(Combiner *c, int k, IR *ir, int r) {
+    *ir = (IR){.ty = IR_MOV, .r0 = ir->r0, .r2 = r, .Line = ir->Line};
+    use(c, k, r);
+}
+
+static void toImm(IR *ir, long long val) {
+    *ir = (IR){.ty = IR_IMM, .r0 = ir->r0, .imm = val, .Line = ir->Line};
+}
+
+static void toNeg(Combiner *c, int k, IR *ir, int r) {
+    *ir = (IR){.ty = IR_NEG, .r0 = ir->r0, .r1 = r, .Line = ir->Line};
+    use(c, k, r);
+}
+
+static int isBinary(IRType ty) {
+    switch (ty) {
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_MOD:
+    case IR_AND:
+    case IR_OR:
+    case IR_XOR:
+    case IR_SHL:
+    case IR_SHR:
+    case IR_EQ:
+    case IR_NE:
+    case IR_LE:
+    case IR_LT:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int isCommutative(IRType ty) {
+    return ty == IR_ADD || ty == IR_MUL || ty == IR_AND || ty == IR_OR ||
+           ty == IR_XOR || ty == IR_EQ || ty == IR_NE;
+}
+
+static int isCompare(IRType ty) {
+    return ty == IR_EQ || ty == IR_NE || ty == IR_LE || ty == IR_LT;
+}
+
+// Folds a constant result into an immediate if it fits one.
+static int fold(IR *ir, IRType ty, long long a, long long b) {
+    long long val;
+    if (!FoldIR(ty, a, b, &val) || val < INT_MIN || val > INT_MAX) return 0;
+    toImm(ir, val);
+    return 1;
+}
+
+// Rewrites ir, the compare (x==0) or (x!=0), to a compare of the
+// operands of x when x is a compare itself.
+static int combineNot(Combiner *c, int k, IR *ir) {
+    IR *cmp = defOf(c, root(c, ir->r1));
+    if (!cmp || !isCompare(cmp->ty)) return 0;
+    int a = cmp->r1, b = cmp->r2;
+    if (c->du->Def[a] == DEF_MANY || c->du->Def[b] == DEF_MANY) return 0;
+
+    if (ir->ty == IR_NE) {
+        toMov(c, k, ir, ir->r1);
+        return 1;
+    }
+
+    // !(a<=b) is b<a and !(a<b) is b<=a.
+    IR not = {.r0 = ir->r0, .r1 = a, .r2 = b, .Line = ir->Line};
+    switch (cmp->ty) {
+    case IR_EQ: not.ty = IR_NE; break;
+    case IR_NE: not.ty = IR_EQ; break;
+    case IR_LE: not = (IR){.ty = IR_LT, .r0 = ir->r0, .r1 = b, .r2 = a, .Line = ir->Line}; break;
+    default:    not = (IR){.ty = IR_LE, .r0 = ir->r0, .r1 = b, .r2 = a, .Line = ir->Line}; break;
+    }
+    *ir = not;
+    use(c, k, a);
+    use(c, k, b);
+    return 1;
+}
+
+// Simplifies the binary operation at site k. Returns 1 if it changed.
+static int combineBinary(Combiner *c, int k, IR *ir) {
+    long long a, b;
+    int ca = isConst(c, ir->r1, &a);
+    int cb = isConst(c, ir->r2, &b);
+    IRType ty = ir->ty;
+
+    if (ca && cb) return fold(ir, ty, a, b);
+
+    if (ca && isCommutative(ty)) {
+        int r = ir->r1;
+        ir->r1 = ir->r2;
+        ir->r2 = r;
+        return 1;
+    }
+
+    if (ca && a == 0) {
+        if (ty == IR_SUB) {
+            toNeg(c, k, ir, ir->r2);
+            return 1;
+        }
+        if (ty == IR_SHL || ty == IR_SHR) {
+            toImm(ir, 0);
+            return 1;
+        }
+    }
+
+    if (cb) {
+        int identity = 0, zero = 0;
+        switch (ty) {
+        case IR_ADD:
+        case IR_SUB:
+        case IR_OR:
+        case IR_XOR:
+            identity = b == 0;
+            break;
+        case IR_SHL:
+        case IR_SHR:
+            // Shift counts are taken modulo 64.
+            identity = (b & 63) == 0;
+            break;
+        case IR_MUL:
+            identity = b == 1;
+            zero = b == 0;
+            break;
+        case IR_DIV:
+            identity = b == 1;
+            break;
+        case IR_MOD:
+            zero = b == 1 || b == -1;
+            break;
+        case IR_AND:
+            identity = b == -1;
+            zero = b == 0;
+            break;
+        default:
+            break;
+        }
+        if (identity) {
+            toMov(c, k, ir, ir->r1);
+            return 1;
+        }
+        if (zero) {
+            toImm(ir, 0);
+            return 1;
+        }
+
+        if (ty == IR_MUL && b == -1) {
+            toNeg(c, k, ir, ir->r1);
+            return 1;
+        }
+
+        // ~~x
+        IR *inner = defOfType(c, ir->r1, IR_XOR);
+        long long d;
+        if (ty == IR_XOR && b == -1 && inner && isConst(c, inner->r2, &d) && d == -1 &&
+            c->du->Def[inner->r1] != DEF_MANY) {
+            toMov(c, k, ir, inner->r1);
+            return 1;
+        }
+
+        if ((ty == IR_EQ || ty == IR_NE) && b == 0 && combineNot(c, k, ir)) return 1;
+    }
+
+    if (root(c, ir->r1) == root(c, ir->r2)) {
+        switch (ty) {
+        case IR_SUB:
+        case IR_XOR:
+        case IR_NE:
+        case IR_LT:
+            toImm(ir, 0);
+            return 1;
+        case IR_EQ:
+        case IR_LE:
+            toImm(ir, 1);
+            return 1;
+        case IR_AND:
+        case IR_OR:
+            toMov(c, k, ir, ir->r1);
+            return 1;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+static int combine(Combiner *c, int k) {
+    IR *ir = SiteIR(&c->du->Sites[k]);
+    if (isBinary(ir->ty)) return combineBinary(c, k, ir);
+
+    if (ir->ty == IR_NEG) {
+        long long a;
+        if (isConst(c, ir->r1, &a)) return fold(ir, IR_NEG, a, 0);
+        IR *inner = defOfType(c, ir->r1, IR_NEG);
+        if (inner && c->du->Def[inner->r1] != DEF_MANY) {
+            toMov(c, k, ir, inner->r1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Combines the instructions of fn until none can be simplified.
+int CombineInstructions(Function *fn) {
+    Combiner c = {0};
+    c.fn = fn;
+    c.du = NewDefUse(fn);
+    c.queued = MemCalloc(MEM_OTHER, c.du->NSites + 1, 1);
+
+    // The worklist is a stack; push backwards to visit in order.
+    for (int k = c.du->NSites - 1; k >= 0; k--) push(&c, k);
+
+    int changed = 0;
+    while (c.work.len) {
+        int k = IntVecPop(&c.work);
+        c.queued[k] = 0;
+        IR *ir = SiteIR(&c.du->Sites[k]);
+        int combined = combine(&c, k);
+        // A move is visited when what it copies changed, which its
+        // users see through it.
+        if (!combined && ir->ty != IR_MOV) continue;
+        if (ir->r0) pushUsers(&c, ir->r0);
+        if (combined) {
+            // Simplify it further before its users look at it again.
+            changed = 1;
+            push(&c, k);
+        }
+    }
+
+    IntVecFree(&c.work);
+    MemFree(c.queued);
+    FreeDefUse(c.du);
+    return changed;
+}
@@ -0,0 +1,8 @@
+#ifndef INSTCOMBINE_H
+#define INSTCOMBINE_H
+
+#include "ir.h"
+
+int CombineInstructions(Function *fn);
+
+#endif
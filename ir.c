@@ -1,4 +1,8 @@
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
 #include "ir.h"
+#include "mem.h"
 #include "token.h"
 
 IRType GetIRType(TokenType ty) {
@@ -34,4 +38,255 @@ IRType GetIRType(TokenType ty) {
     default:
         return IR_ILLEGAL;
     }
-}
\ No newline at end of file
+}
+
+char *GetIRTypeName(IRType ty) {
+    switch (ty) {
+    case IR_ADD:
+        return "add";
+    case IR_SUB:
+        return "sub";
+    case IR_MUL:
+        return "mul";
+    case IR_DIV:
+        return "div";
+    case IR_IMM:
+        return "imm";
+    case IR_BPREL:
+        return "bprel";
+    case IR_MOV:
+        return "mov";
+    case IR_RETURN:
+        return "return";
+    case IR_CALL:
+        return "call";
+    case IR_LABEL_ADDR:
+        return "label_addr";
+    case IR_EQ:
+        return "eq";
+    case IR_NE:
+        return "ne";
+    case IR_LE:
+        return "le";
+    case IR_LT:
+        return "lt";
+    case IR_AND:
+        return "and";
+    case IR_OR:
+        return "or";
+    case IR_XOR:
+        return "xor";
+    case IR_SHL:
+        return "shl";
+    case IR_SHR:
+        return "shr";
+    case IR_MOD:
+        return "mod";
+    case IR_NEG:
+        return "neg";
+    case IR_JMP:
+        return "jmp";
+    case IR_TEST:
+        return "test";
+    case IR_LOAD:
+        return "load";
+    case IR_LOAD_SPILL:
+        return "load_spill";
+    case IR_LOAD_ARG:
+        return "load_arg";
+    case IR_STORE:
+        return "store";
+    case IR_STORE_ARG:
+        return "store_arg";
+    case IR_STORE_SPILL:
+        return "store_spill";
+    case IR_NOP:
+        return "nop";
+    default:
+        return NULL;
+    }
+}
+
+// Computes a ty b, or ty a for a unary operator, the way the generated
+// code does on 64-bit registers. Returns 0 if ty is no arithmetic
+// operator or the result is undefined.
+int FoldIR(IRType ty, long long a, long long b, long long *result) {
+    unsigned long long x = a, y = b;
+    switch (ty) {
+    case IR_NEG: *result = -x; return 1;
+    case IR_ADD: *result = x + y; return 1;
+    case IR_SUB: *result = x - y; return 1;
+    case IR_MUL: *result = x * y; return 1;
+    case IR_AND: *result = a & b; return 1;
+    case IR_OR:  *result = a | b; return 1;
+    case IR_XOR: *result = a ^ b; return 1;
+    case IR_SHL: *result = x << (y & 63); return 1;
+    case IR_SHR: *result = x >> (y & 63); return 1;
+    case IR_EQ:  *result = a == b; return 1;
+    case IR_NE:  *result = a != b; return 1;
+    case IR_LE:  *result = a <= b; return 1;
+    case IR_LT:  *result = a < b; return 1;
+    case IR_DIV:
+    case IR_MOD:
+        // idiv traps on these.
+        if (b == 0 || (b == -1 && a == LLONG_MIN)) return 0;
+        *result = ty == IR_DIV ? a / b : a % b;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+DefUse *NewDefUse(Function *fn) {
+    DefUse *du = MemCalloc(MEM_OTHER, 1, sizeof(DefUse));
+    du->NRegs = fn->NRegs;
+    du->Def = MemMalloc(MEM_OTHER, sizeof(int) * (fn->NRegs + 1));
+    du->Users = MemCalloc(MEM_OTHER, fn->NRegs + 1, sizeof(IntVec));
+    for (int i = 0; i <= fn->NRegs; i++) du->Def[i] = DEF_NONE;
+
+    for (int i = 0; i < fn->bbs.len; i++) du->NSites += BBVecGet(&fn->bbs, i)->IRs.len;
+    du->Sites = MemMalloc(MEM_OTHER, sizeof(IRSite) * (du->NSites + 1));
+
+    // Parameters are definitions without a site; a second definition of
+    // either kind makes a register DEF_MANY.
+    char *params = MemCalloc(MEM_OTHER, fn->NRegs + 1, 1);
+    IntVec uses = {0};
+    int k = 0;
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        for (int i = 0; i < bb->Params.len; i++) {
+            int r = IntVecGet(&bb->Params, i);
+            if (params[r] || du->Def[r] != DEF_NONE) du->Def[r] = DEF_MANY;
+            params[r] = 1;
+        }
+        for (int i = 0; i < bb->IRs.len; i++, k++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            du->Sites[k] = (IRSite){bb, i};
+            IRUses(fn, ir, &uses);
+            for (int i = 0; i < uses.len; i++) IntVecPush(&du->Users[IntVecGet(&uses, i)], k);
+            if (!ir->r0) continue;
+            du->Def[ir->r0] = params[ir->r0] || du->Def[ir->r0] != DEF_NONE ? DEF_MANY : k;
+        }
+    }
+    IntVecFree(&uses);
+    MemFree(params);
+    return du;
+}
+
+void FreeDefUse(DefUse *du) {
+    for (int i = 0; i <= du->NRegs; i++) IntVecFree(&du->Users[i]);
+    MemFree(du->Users);
+    MemFree(du->Def);
+    MemFree(du->Sites);
+    MemFree(du);
+}
+
+// Returns the position of a local variable in fn->LocalVars, or -1.
+int LocalIndex(Function *fn, Var *var) {
+    for (int i = 0; i < VectorSize(fn->LocalVars); i++) {
+        if (VectorGet(fn->LocalVars, i) == var) return i;
+    }
+    return -1;
+}
+
+// Sets uses to the registers ir reads and returns their number.
+int IRUses(Function *fn, IR *ir, IntVec *uses) {
+    uses->len = 0;
+    if (ir->r1) IntVecPush(uses, ir->r1);
+    if (ir->r2) IntVecPush(uses, ir->r2);
+    if (ir->ty == IR_JMP) {
+        for (int i = 0; i < ir->NBBArgs; i++) IntVecPush(uses, IRBBArgs(fn, ir)[i]);
+    }
+    if (ir->ty == IR_CALL) {
+        for (int i = 0; i < ir->NArgs; i++) IntVecPush(uses, IRArgs(fn, ir)[i]);
+    }
+    return uses->len;
+}
+
+// Makes the n registers in args, which must not point into
+// fn->Args, the arguments of the jmp ir.
+void SetBBArgs(Function *fn, IR *ir, int *args, int n) {
+    ir->BBArgs = fn->Args.len;
+    ir->NBBArgs = n;
+    for (int i = 0; i < n; i++) IntVecPush(&fn->Args, args[i]);
+}
+
+// Adds a virtual register to fn and returns its number.
+int AddReg(Function *fn) {
+    RegVecPush(&fn->Regs, (Reg){.RealNum = -1});
+    return ++fn->NRegs;
+}
+
+void IROpen(IRCursor *c, BB *bb) {
+    c->bb = bb;
+    c->gap = c->pos = 0;
+    c->end = bb->IRs.len;
+}
+
+// Returns the current instruction, or NULL past the last one.
+IR *IRCur(IRCursor *c) {
+    return c->pos < c->end ? IRVecData(&c->bb->IRs) + c->pos : NULL;
+}
+
+void IRNext(IRCursor *c) {
+    assert(c->pos < c->end);
+    IR *data = IRVecData(&c->bb->IRs);
+    if (c->gap != c->pos) data[c->gap] = data[c->pos];
+    c->gap++;
+    c->pos++;
+}
+
+// Makes sure the gap is not empty, moving the instructions after it
+// to the end of the (possibly grown) array.
+static IR *openGap(IRCursor *c) {
+    IRVec *v = &c->bb->IRs;
+    if (c->gap < c->pos) return IRVecData(v);
+
+    v->len = c->end;
+    int capacity = v->capacity ? v->capacity : VEC_INLINE;
+    if (c->end == capacity) {
+        IRVecReserve(v, capacity + 1);
+        capacity = v->capacity;
+    }
+
+    IR *data = IRVecData(v);
+    int shift = capacity - c->end;
+    memmove(data + c->pos + shift, data + c->pos, sizeof(IR) * (c->end - c->pos));
+    c->pos += shift;
+    c->end += shift;
+    v->len = c->end;
+    return data;
+}
+
+// Inserts ir before the current instruction; the cursor does not
+// visit it.
+IR *IRInsertBefore(IRCursor *c, IR ir) {
+    IR *data = openGap(c);
+    data[c->gap] = ir;
+    return &data[c->gap++];
+}
+
+// Inserts ir after the current instruction; the cursor visits it next.
+IR *IRInsertAfter(IRCursor *c, IR ir) {
+    assert(c->pos < c->end);
+    IR *data = openGap(c);
+    c->pos--;
+    data[c->pos] = data[c->pos + 1];
+    data[c->pos + 1] = ir;
+    return &data[c->pos + 1];
+}
+
+// Removes the current instruction, moving to the next one.
+void IRErase(IRCursor *c) {
+    assert(c->pos < c->end);
+    c->pos++;
+}
+
+void IRClose(IRCursor *c) {
+    IRVec *v = &c->bb->IRs;
+    IR *data = IRVecData(v);
+    if (c->gap != c->pos) {
+        memmove(data + c->gap, data + c->pos, sizeof(IR) * (c->end - c->pos));
+    }
+    v->len = c->gap + c->end - c->pos;
+}
@@ -4,6 +4,7 @@
 #include "ast.h"
 
 typedef struct IR IR;
+typedef struct Loop Loop;
 typedef enum IRType IRType;
 
 enum IRType {
@@ -28,45 +29,173 @@ enum IRType {
     IR_SHL,
     IR_SHR,
     IR_MOD,
+    IR_NEG,
     IR_JMP,
     IR_TEST,
     IR_LOAD,
     IR_LOAD_SPILL,
+    IR_LOAD_ARG,
     IR_STORE,
     IR_STORE_ARG,
     IR_STORE_SPILL,
     IR_NOP,
 };
 
+// Instructions are stored by value in the array of their block and
+// name registers by number, so they stay small and are walked in
+// memory order. Only the fields of the instruction's type are
+// meaningful; the others may overlap with them.
 struct IR {
     IRType ty;
 
-    Reg *r0;
-    Reg *r1;
-    Reg *r2;
+    int r0;
+    int r1;
+    int r2;
 
-    int imm;
-    int Label;
-    Var *ID;
-
-    BB *bb1;
-    BB *bb2;
+    union {
+        int imm;
+        // For SSA: the arguments a jmp passes to the parameters of
+        // bb1, one per parameter, starting at index BBArgs in
+        // Function.Args
+        struct {
+            int BBArgs;
+            int NBBArgs;
+        };
+    };
 
     // Load/store size in bytes
     int Size;
 
-    // Function call
-    char *Name;
-    int NArgs;
-    Reg *Args[6];
+    // Source line, 0 if unknown
+    int Line;
+
+    union {
+        // Jump and branch targets
+        struct {
+            BB *bb1;
+            BB *bb2;
+        };
+
+        // Local variable of bprel, store_arg and spill code
+        Var *ID;
+
+        // Function call and label address
+        struct {
+            char *Name;
+            int Args; // index of the first argument in Function.Args
+            int NArgs;
+        };
+    };
+};
+
+DEFINE_STRUCT_VEC(IRVec, IR, MEM_IR)
 
-    // For liveness tracking
-    Vector *Kill;
+// An instruction, by its block and position there.
+typedef struct IRSite {
+    BB *bb;
+    int i;
+} IRSite;
 
-    // For SSA
-    Reg *bbArg;
+enum {
+    DEF_NONE = -1, // defined by no instruction: a block parameter or undefined
+    DEF_MANY = -2, // defined more than once, so not in SSA form
 };
 
+// The definitions and uses of the registers of a function, which stay
+// valid as long as no instruction is inserted, erased or changed to
+// read or write other registers.
+typedef struct DefUse {
+    IRSite *Sites;
+    int NSites;
+    int *Def;      // per register: the site defining it, or DEF_*
+    IntVec *Users; // per register: the sites reading it, once per read
+    int NRegs;
+} DefUse;
+
+struct BB {
+    int Label;
+    IRVec IRs;
+
+    // For SSA: registers defined on entry to the block by the
+    // arguments of the jumps to it
+    IntVec Params;
+
+    // For control flow analysis
+    BBVec Succ;
+    BBVec Pred;
+    int RPO; // reverse postorder number, -1 if unreachable
+
+    // For dominator analysis
+    BB *IDom;
+    BBVec DomChildren;
+    int DomPre, DomPost; // preorder and postorder numbers in the dominator tree
+    BBVec Frontier;
+
+    // For loop analysis
+    Loop *Loop; // innermost loop containing the block
+
+    // For liveness analysis
+    BitSet *DefRegs;
+    BitSet *UseRegs; // used before any definition in the block
+    BitSet *InRegs;
+    BitSet *OutRegs;
+};
+
+// A natural loop: the header and every block that can reach one of
+// its back edges without going through the header.
+struct Loop {
+    BB *Header;
+    BBVec Blocks; // including those of inner loops
+    Loop *Parent;
+    int Depth; // 1 for outermost loops
+};
+
+
+// An IRCursor walks the instructions of a block and edits them in
+// place. The block's array keeps a gap right before the current
+// instruction, so inserting or erasing there costs O(1) amortized and
+// a walk that edits nothing moves nothing. Nothing else may look at
+// bb->IRs until IRClose closes the gap. Pointers into the block are
+// invalidated by insertions.
+typedef struct IRCursor {
+    BB *bb;
+    int gap; // start of the gap; the instructions before it are done
+    int pos; // the current instruction, right after the gap
+    int end; // one past the last instruction
+} IRCursor;
+
+void IROpen(IRCursor *c, BB *bb);
+IR *IRCur(IRCursor *c);
+void IRNext(IRCursor *c);
+IR *IRInsertBefore(IRCursor *c, IR ir);
+IR *IRInsertAfter(IRCursor *c, IR ir);
+void IRErase(IRCursor *c);
+void IRClose(IRCursor *c);
+
 IRType GetIRType(TokenType ty);
+char *GetIRTypeName(IRType ty);
+int LocalIndex(Function *fn, Var *var);
+int IRUses(Function *fn, IR *ir, IntVec *uses);
+int FoldIR(IRType ty, long long a, long long b, long long *result);
+DefUse *NewDefUse(Function *fn);
+void FreeDefUse(DefUse *du);
+void SetBBArgs(Function *fn, IR *ir, int *args, int n);
+int AddReg(Function *fn);
+
+static inline Reg *GetReg(Function *fn, int r) {
+    return RegVecData(&fn->Regs) + r;
+}
+
+static inline int *IRArgs(Function *fn, IR *ir) {
+    return IntVecData(&fn->Args) + ir->Args;
+}
+
+static inline int *IRBBArgs(Function *fn, IR *ir) {
+    return IntVecData(&fn->Args) + ir->BBArgs;
+}
+
+static inline IR *SiteIR(IRSite *s) {
+    return IRVecData(&s->bb->IRs) + s->i;
+}
 
 #endif
\ No newline at end of file
@@ -0,0 +1,466 @@
+// Binary IR module writer and loader.
+//
+// The writer flattens a Program into the tables described in
+// ir_binary.h. The loader maps a module file read-only and
+// instantiates the Program the backend works on with one allocation
+// per table rather than one per node; names and global data are used
+// in place from the mapping.
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ir_binary.h"
+#include "mem.h"
+
+extern int nLabel;
+
+typedef struct Writer {
+    StringBuilder *globals;
+    StringBuilder *funcs;
+    StringBuilder *locals;
+    StringBuilder *blocks;
+    StringBuilder *insts;
+    StringBuilder *args;
+    StringBuilder *strs;
+
+    // Interned strings: open addressing over the string table.
+    int *table;
+    int capacity;
+    int len;
+
+    int nLabel;
+
+    // Per function state.
+    int labelBase;
+    int *blockIndex; // block index by label - labelBase
+} Writer;
+
+static unsigned hash(char *s) {
+    unsigned h = 2166136261u;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static void growTable(Writer *w) {
+    int *old = w->table;
+    int oldCapacity = w->capacity;
+
+    w->capacity = oldCapacity ? oldCapacity * 2 : 256;
+    w->table = MemMalloc(MEM_OTHER, sizeof(int) * w->capacity);
+    memset(w->table, -1, sizeof(int) * w->capacity);
+
+    for (int i = 0; i < oldCapacity; i++) {
+        if (old[i] < 0) continue;
+        unsigned h = hash(w->strs->data + old[i]) & (w->capacity - 1);
+        while (w->table[h] >= 0) h = (h + 1) & (w->capacity - 1);
+        w->table[h] = old[i];
+    }
+    MemFree(old);
+}
+
+// Returns the offset of s in the string table, adding it if needed.
+static int intern(Writer *w, char *s) {
+    if (!s) return -1;
+    if (w->len * 2 >= w->capacity) growTable(w);
+
+    unsigned h = hash(s) & (w->capacity - 1);
+    while (w->table[h] >= 0) {
+        if (!strcmp(w->strs->data + w->table[h], s)) return w->table[h];
+        h = (h + 1) & (w->capacity - 1);
+    }
+
+    int off = w->strs->len;
+    StringBuilderAppendN(w->strs, s, strlen(s) + 1);
+    w->table[h] = off;
+    w->len++;
+    return off;
+}
+
+static int blob(Writer *w, char *data, int len) {
+    int off = w->strs->len;
+    StringBuilderAppendN(w->strs, data, len);
+    return off;
+}
+
+#define COUNT(sb, T) ((sb)->len / (int)sizeof(T))
+#define APPEND(sb, rec) StringBuilderAppendN(sb, (char *)&(rec), sizeof(rec))
+
+static int blockIndex(Writer *w, BB *bb) {
+    return w->blockIndex[bb->Label - w->labelBase];
+}
+
+static void writeInst(Writer *w, Function *fn, IR *ir) {
+    IRBinInst rec = {0};
+    rec.ty = ir->ty;
+    rec.r0 = ir->r0;
+    rec.r1 = ir->r1;
+    rec.r2 = ir->r2;
+    rec.Size = ir->Size;
+    rec.Line = ir->Line;
+    rec.bb1 = rec.bb2 = rec.Local = rec.Name = -1;
+    rec.FirstArg = COUNT(w->args, int);
+
+    switch (ir->ty) {
+    case IR_JMP:
+        rec.bb1 = blockIndex(w, ir->bb1);
+        for (int i = 0; i < ir->NBBArgs; i++) {
+            APPEND(w->args, IRBBArgs(fn, ir)[i]);
+        }
+        rec.NArgs = ir->NBBArgs;
+        break;
+    case IR_TEST:
+        rec.bb1 = blockIndex(w, ir->bb1);
+        rec.bb2 = blockIndex(w, ir->bb2);
+        break;
+    case IR_BPREL:
+    case IR_STORE_ARG:
+    case IR_LOAD_SPILL:
+    case IR_STORE_SPILL:
+        rec.imm = ir->imm;
+        rec.Local = LocalIndex(fn, ir->ID);
+        break;
+    case IR_CALL:
+        rec.Name = intern(w, ir->Name);
+        for (int i = 0; i < ir->NArgs; i++) {
+            APPEND(w->args, IRArgs(fn, ir)[i]);
+        }
+        rec.NArgs = ir->NArgs;
+        break;
+    case IR_LABEL_ADDR:
+        rec.Name = intern(w, ir->Name);
+        break;
+    default:
+        rec.imm = ir->imm;
+    }
+    APPEND(w->insts, rec);
+}
+
+static void writeFunction(Writer *w, Function *fn) {
+    // Labels of a function occupy a contiguous range, so blocks are
+    // looked up relative to the lowest label in use.
+    int labelLo = 1 << 30, labelHi = -1;
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        if (bb->Label < labelLo) labelLo = bb->Label;
+        if (bb->Label > labelHi) labelHi = bb->Label;
+    }
+    w->labelBase = labelLo;
+    if (labelHi >= w->nLabel) w->nLabel = labelHi + 1;
+
+    w->blockIndex = MemCalloc(MEM_OTHER, labelHi - labelLo + 2, sizeof(int));
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        w->blockIndex[bb->Label - labelLo] = i;
+    }
+
+    IRBinFunc f = {0};
+    f.Name = intern(w, fn->Name);
+    f.FirstLocal = COUNT(w->locals, IRBinLocal);
+    f.NLocals = VectorSize(fn->LocalVars);
+    f.FirstBlock = COUNT(w->blocks, IRBinBlock);
+    f.NBlocks = fn->bbs.len;
+    f.NRegs = fn->NRegs;
+    f.Line = fn->Line;
+    APPEND(w->funcs, f);
+
+    for (int i = 0; i < VectorSize(fn->LocalVars); i++) {
+        Var *var = VectorGet(fn->LocalVars, i);
+        IRBinLocal l = {intern(w, var->Name), var->ty->Size, var->ty->Align};
+        APPEND(w->locals, l);
+    }
+
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        IRBinBlock b = {0};
+        b.Label = bb->Label;
+        b.FirstParam = COUNT(w->args, int);
+        b.NParams = bb->Params.len;
+        for (int i = 0; i < bb->Params.len; i++) {
+            int param = IntVecGet(&bb->Params, i);
+            APPEND(w->args, param);
+        }
+        b.FirstInst = COUNT(w->insts, IRBinInst);
+        b.NInsts = bb->IRs.len;
+        APPEND(w->blocks, b);
+
+        for (int i = 0; i < bb->IRs.len; i++) {
+            writeInst(w, fn, IRVecData(&bb->IRs) + i);
+        }
+    }
+    MemFree(w->blockIndex);
+}
+
+static void writeGlobal(Writer *w, Var *var) {
+    IRBinGlobal g = {0};
+    g.Name = intern(w, var->Name);
+    g.Size = var->ty->Size;
+    g.Align = var->ty->Align;
+    if (var->StringData) {
+        g.Kind = IRBIN_STRING;
+        g.Data = blob(w, var->StringData, var->ty->Size);
+        g.DataSize = var->ty->Size;
+    } else if (var->RawData) {
+        g.Kind = IRBIN_DATA;
+        g.Data = blob(w, var->RawData, var->RawDataSize);
+        g.DataSize = var->RawDataSize;
+    } else {
+        g.Kind = IRBIN_BSS;
+    }
+    APPEND(w->globals, g);
+}
+
+void WriteIRBinary(Program *prog, FILE *fp) {
+    Writer *w = MemCalloc(MEM_OTHER, 1, sizeof(Writer));
+    w->globals = NewStringBuilder();
+    w->funcs = NewStringBuilder();
+    w->locals = NewStringBuilder();
+    w->blocks = NewStringBuilder();
+    w->insts = NewStringBuilder();
+    w->args = NewStringBuilder();
+    w->strs = NewStringBuilder();
+    w->nLabel = nLabel;
+    int file = intern(w, prog->File);
+
+    for (int i = 0; i < VectorSize(prog->GlobalVars); i++) {
+        writeGlobal(w, VectorGet(prog->GlobalVars, i));
+    }
+    for (int i = 0; i < VectorSize(prog->Functions); i++) {
+        writeFunction(w, VectorGet(prog->Functions, i));
+    }
+
+    IRBinHeader h = {0};
+    h.Magic = IRBIN_MAGIC;
+    h.Version = IRBIN_VERSION;
+    h.NLabel = w->nLabel;
+    h.File = file;
+
+    int off = sizeof(h);
+    StringBuilder *tables[] = {w->globals, w->funcs, w->locals, w->blocks, w->insts, w->args, w->strs};
+    int *offsets[] = {&h.GlobalOff, &h.FuncOff, &h.LocalOff, &h.BlockOff, &h.InstOff, &h.ArgOff, &h.StrOff};
+    for (int i = 0; i < 7; i++) {
+        *offsets[i] = off;
+        off += tables[i]->len;
+    }
+    h.NGlobals = COUNT(w->globals, IRBinGlobal);
+    h.NFuncs = COUNT(w->funcs, IRBinFunc);
+    h.NLocals = COUNT(w->locals, IRBinLocal);
+    h.NBlocks = COUNT(w->blocks, IRBinBlock);
+    h.NInsts = COUNT(w->insts, IRBinInst);
+    h.NArgs = COUNT(w->args, int);
+    h.StrSize = w->strs->len;
+
+    fwrite(&h, sizeof(h), 1, fp);
+    for (int i = 0; i < 7; i++) {
+        fwrite(tables[i]->data, 1, tables[i]->len, fp);
+    }
+}
+
+static void corrupt(char *path, char *what) {
+    fprintf(stderr, "IR Error:\nFile: %s.\ncorrupt IR module: %s\n", path, what);
+    exit(1);
+}
+
+static int check(IRModule *m, int cond) {
+    if (!cond) corrupt(m->Path, "index out of range");
+    return 1;
+}
+
+static int inBounds(long off, long n, long size, long fileSize) {
+    return off >= 0 && n >= 0 && off + n * size <= fileSize;
+}
+
+// Returns the n bytes at off in the string table.
+static char *blobAt(IRModule *m, int off, int n) {
+    if (!inBounds(off, n, 1, m->Header->StrSize)) corrupt(m->Path, "data out of range");
+    return m->Strings + off;
+}
+
+// Returns the string at off in the string table.
+static char *stringAt(IRModule *m, int off) {
+    int size = m->Header->StrSize;
+    if (off < 0 || off >= size) corrupt(m->Path, "string out of range");
+    if (!memchr(m->Strings + off, 0, size - off)) corrupt(m->Path, "unterminated string");
+    return m->Strings + off;
+}
+
+IRModule *MapIRModule(char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open file '%s' for reading\n", path);
+        exit(1);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    if (st.st_size < sizeof(IRBinHeader)) corrupt(path, "truncated header");
+
+    char *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Failed to map file '%s'\n", path);
+        exit(1);
+    }
+
+    IRBinHeader *h = (IRBinHeader *)base;
+    if (h->Magic != IRBIN_MAGIC) corrupt(path, "bad magic");
+    if (h->Version != IRBIN_VERSION) corrupt(path, "unsupported version");
+
+    long size = st.st_size;
+    if (!inBounds(h->GlobalOff, h->NGlobals, sizeof(IRBinGlobal), size) ||
+        !inBounds(h->FuncOff, h->NFuncs, sizeof(IRBinFunc), size) ||
+        !inBounds(h->LocalOff, h->NLocals, sizeof(IRBinLocal), size) ||
+        !inBounds(h->BlockOff, h->NBlocks, sizeof(IRBinBlock), size) ||
+        !inBounds(h->InstOff, h->NInsts, sizeof(IRBinInst), size) ||
+        !inBounds(h->ArgOff, h->NArgs, sizeof(int), size) ||
+        !inBounds(h->StrOff, h->StrSize, 1, size)) {
+        corrupt(path, "table out of bounds");
+    }
+
+    IRModule *m = MemCalloc(MEM_OTHER, 1, sizeof(IRModule));
+    m->Path = path;
+    m->Header = h;
+    m->Globals = (IRBinGlobal *)(base + h->GlobalOff);
+    m->Funcs = (IRBinFunc *)(base + h->FuncOff);
+    m->Locals = (IRBinLocal *)(base + h->LocalOff);
+    m->Blocks = (IRBinBlock *)(base + h->BlockOff);
+    m->Insts = (IRBinInst *)(base + h->InstOff);
+    m->Args = (int *)(base + h->ArgOff);
+    m->Strings = base + h->StrOff;
+    return m;
+}
+
+// Returns a vector holding n elements of data.
+static Vector *vectorOf(void **data, int n) {
+    Vector *v = MemCalloc(MEM_VECTOR, 1, sizeof(Vector));
+    v->capacity = n > 16 ? n : 16;
+    v->data = MemMalloc(MEM_VECTOR, sizeof(void *) * v->capacity);
+    memcpy(v->data, data, sizeof(void *) * n);
+    v->len = n;
+    return v;
+}
+
+Program *LoadIRModule(IRModule *m) {
+    IRBinHeader *h = m->Header;
+    Program *prog = NewProgram();
+    prog->macros = NewMap();
+    if (h->NLabel > nLabel) nLabel = h->NLabel;
+    if (h->File >= 0) prog->File = stringAt(m, h->File);
+
+    Var *globals = MemCalloc(MEM_AST, h->NGlobals, sizeof(Var));
+    Type *globalTypes = MemCalloc(MEM_TYPE, h->NGlobals, sizeof(Type));
+    for (int i = 0; i < h->NGlobals; i++) {
+        IRBinGlobal *g = &m->Globals[i];
+        Var *var = &globals[i];
+        var->ty = &globalTypes[i];
+        var->ty->ty = ARRAY;
+        check(m, g->Size >= 0 && g->Align >= 0 && g->Kind >= IRBIN_BSS && g->Kind <= IRBIN_DATA);
+        var->ty->Size = g->Size;
+        var->ty->Align = g->Align;
+        var->Name = stringAt(m, g->Name);
+        if (g->Kind == IRBIN_STRING) var->StringData = blobAt(m, g->Data, g->Size);
+        if (g->Kind == IRBIN_DATA) {
+            check(m, g->DataSize <= g->Size);
+            var->RawData = blobAt(m, g->Data, g->DataSize);
+            var->RawDataSize = g->DataSize;
+        }
+        VectorPush(prog->GlobalVars, var);
+    }
+
+    Var *locals = MemCalloc(MEM_AST, h->NLocals, sizeof(Var));
+    Type *localTypes = MemCalloc(MEM_TYPE, h->NLocals, sizeof(Type));
+    for (int i = 0; i < h->NLocals; i++) {
+        Var *var = &locals[i];
+        var->ty = &localTypes[i];
+        var->ty->ty = ARRAY;
+        check(m, m->Locals[i].Size >= 0 && m->Locals[i].Align >= 0);
+        var->ty->Size = m->Locals[i].Size;
+        var->ty->Align = m->Locals[i].Align;
+        var->Name = stringAt(m, m->Locals[i].Name);
+        var->Local = 1;
+    }
+
+    BB *bbs = MemCalloc(MEM_BB, h->NBlocks, sizeof(BB));
+    void **scratch = MemMalloc(MEM_OTHER, sizeof(void *) * (h->NLocals + 1));
+
+    for (int i = 0; i < h->NFuncs; i++) {
+        IRBinFunc *f = &m->Funcs[i];
+        check(m, inBounds(f->FirstLocal, f->NLocals, 1, h->NLocals));
+        check(m, inBounds(f->FirstBlock, f->NBlocks, 1, h->NBlocks));
+        check(m, f->NRegs >= 0);
+#define REG(idx) (check(m, (idx) >= 0 && (idx) <= f->NRegs), (idx))
+
+        Function *fn = NewFunction();
+        fn->Name = stringAt(m, f->Name);
+        fn->Line = f->Line;
+        RegVecReserve(&fn->Regs, f->NRegs + 1);
+        for (int i = 0; i < f->NRegs; i++) AddReg(fn);
+        fn->Params = NewVector();
+        for (int i = 0; i < f->NLocals; i++) scratch[i] = &locals[f->FirstLocal + i];
+        fn->LocalVars = vectorOf(scratch, f->NLocals);
+
+        BB *fbbs = &bbs[f->FirstBlock];
+        BBVecReserve(&fn->bbs, f->NBlocks);
+        for (int i = 0; i < f->NBlocks; i++) BBVecPush(&fn->bbs, &fbbs[i]);
+
+        for (int i = 0; i < f->NBlocks; i++) {
+            IRBinBlock *b = &m->Blocks[f->FirstBlock + i];
+            BB *bb = &fbbs[i];
+            check(m, inBounds(b->FirstInst, b->NInsts, 1, h->NInsts));
+            check(m, inBounds(b->FirstParam, b->NParams, 1, h->NArgs));
+            bb->Label = b->Label;
+            for (int i = 0; i < b->NParams; i++) {
+                IntVecPush(&bb->Params, REG(m->Args[b->FirstParam + i]));
+            }
+
+            IRVecReserve(&bb->IRs, b->NInsts);
+            bb->IRs.len = b->NInsts;
+            for (int i = 0; i < b->NInsts; i++) {
+                IRBinInst *rec = &m->Insts[b->FirstInst + i];
+                IR *ir = IRVecData(&bb->IRs) + i;
+                check(m, rec->ty >= IR_ADD && rec->ty <= IR_NOP);
+                check(m, rec->bb1 < f->NBlocks && rec->bb2 < f->NBlocks && rec->Local < f->NLocals);
+                check(m, rec->ty != IR_CALL || rec->NArgs <= 6);
+                check(m, inBounds(rec->FirstArg, rec->NArgs, 1, h->NArgs));
+                *ir = (IR){.ty = rec->ty, .r0 = REG(rec->r0), .r1 = REG(rec->r1), .r2 = REG(rec->r2)};
+                ir->imm = rec->imm;
+                ir->Size = rec->Size;
+                ir->Line = rec->Line;
+
+                switch (ir->ty) {
+                case IR_JMP:
+                case IR_TEST:
+                    check(m, rec->bb1 >= 0 && (ir->ty == IR_JMP || rec->bb2 >= 0));
+                    ir->bb1 = &fbbs[rec->bb1];
+                    ir->bb2 = ir->ty == IR_TEST ? &fbbs[rec->bb2] : NULL;
+                    ir->BBArgs = fn->Args.len;
+                    ir->NBBArgs = ir->ty == IR_JMP ? rec->NArgs : 0;
+                    for (int i = 0; i < ir->NBBArgs; i++) {
+                        IntVecPush(&fn->Args, REG(m->Args[rec->FirstArg + i]));
+                    }
+                    break;
+                case IR_BPREL:
+                case IR_STORE_ARG:
+                case IR_LOAD_SPILL:
+                case IR_STORE_SPILL:
+                    check(m, rec->Local >= 0);
+                    ir->ID = &locals[f->FirstLocal + rec->Local];
+                    break;
+                case IR_CALL:
+                case IR_LABEL_ADDR:
+                    ir->Name = stringAt(m, rec->Name);
+                    ir->Args = fn->Args.len;
+                    ir->NArgs = ir->ty == IR_CALL ? rec->NArgs : 0;
+                    for (int i = 0; i < ir->NArgs; i++) {
+                        IntVecPush(&fn->Args, REG(m->Args[rec->FirstArg + i]));
+                    }
+                    break;
+                }
+            }
+        }
+#undef REG
+        VectorPush(prog->Functions, fn);
+    }
+    MemFree(scratch);
+    return prog;
+}
@@ -0,0 +1,101 @@
+#ifndef IR_BINARY_H
+#define IR_BINARY_H
+
+#include <stdio.h>
+#include "ir.h"
+
+// Binary IR module.
+//
+// A module is a header followed by flat tables of fixed-size records.
+// Records refer to each other by index and to names by offset into
+// the string table, never by pointer, so a module can be mapped into
+// memory and its tables read in place.
+//
+// Register, local and block indices are relative to the enclosing
+// function. Registers keep their numbers, 1..NRegs, so that 0 means
+// "no register"; block and local indices are -1 when absent.
+
+#define IRBIN_MAGIC 0x42524958 // "XIRB"
+#define IRBIN_VERSION 6
+
+typedef struct IRBinHeader {
+    int Magic;
+    int Version;
+    int NLabel; // first label number not used by the module
+    int File;   // the source file name in the string table, or -1
+
+    int NGlobals, GlobalOff;
+    int NFuncs, FuncOff;
+    int NLocals, LocalOff;
+    int NBlocks, BlockOff;
+    int NInsts, InstOff;
+    int NArgs, ArgOff;
+    int StrSize, StrOff;
+} IRBinHeader;
+
+enum {
+    IRBIN_BSS,
+    IRBIN_STRING,
+    IRBIN_DATA,
+};
+
+typedef struct IRBinGlobal {
+    int Name;
+    int Size;
+    int Align;
+    int Kind;
+    int Data;     // offset into the string table
+    int DataSize;
+} IRBinGlobal;
+
+typedef struct IRBinFunc {
+    int Name;
+    int FirstLocal, NLocals;
+    int FirstBlock, NBlocks;
+    int NRegs;
+    int Line;
+} IRBinFunc;
+
+typedef struct IRBinLocal {
+    int Name;
+    int Size;
+    int Align;
+} IRBinLocal;
+
+typedef struct IRBinBlock {
+    int Label;
+    int FirstParam, NParams; // parameters, in the argument table
+    int FirstInst, NInsts;
+} IRBinBlock;
+
+typedef struct IRBinInst {
+    int ty;
+    int r0, r1, r2;
+    int imm;
+    int Size;
+    int bb1, bb2;
+    int Local;
+    int Name;
+    int FirstArg, NArgs; // arguments of a call or a jmp
+    int Line;
+} IRBinInst;
+
+// A module mapped into memory. The table pointers point into the
+// mapping.
+typedef struct IRModule {
+    char *Path;
+    IRBinHeader *Header;
+    IRBinGlobal *Globals;
+    IRBinFunc *Funcs;
+    IRBinLocal *Locals;
+    IRBinBlock *Blocks;
+    IRBinInst *Insts;
+    int *Args;
+    char *Strings;
+} IRModule;
+
+void WriteIRBinary(Program *prog, FILE *fp);
+IRModule *MapIRModule(char *path);
+Program *LoadIRModule(IRModule *m);
+
+#endif
@@ -0,0 +1,552 @@
+// Textual IR dump and reader.
+//
+// A program is printed as the source file it was compiled from, if
+// known, and a list of global data definitions followed by functions:
+//
+//  file "main.c"
+//  string .L.str1 4 "%d\n\000"
+//  data g 4 "\005\000\000\000"
+//  bss arr 40
+//
+//  func main line 3
+//  local $0 4 4 "x"
+//  .L2:
+//      jmp .L3
+//  .L3:
+//      line 4
+//      r1 = bprel $0
+//      r2 = load r1, 4
+//      test r2, .L4, .L5
+//  .L6(r7, r9):
+//      line 5
+//      r8 = call printf(r3, r7)
+//      jmp .L6(r8, r9)
+//  end
+//
+// A `line N` in a function gives the source line of the instructions
+// after it, up to the next one; the source line is 0 before the first.
+//
+// Virtual registers are written as rN, local variables as $N (their
+// index in Function.LocalVars) and basic blocks as .LN. Block
+// parameters are written in parentheses after the label, and the
+// arguments passed to them after the target of a jmp. Anything after
+// ';' up to the end of the line is a comment.
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ir_text.h"
+#include "mem.h"
+
+extern int nLabel;
+
+static void printString(char *s, int len) {
+    printf("\"");
+    for (int i = 0; i < len; i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (isgraph(c) || c == ' ') {
+            printf("%c", c);
+        } else {
+            printf("\\%03o", c);
+        }
+    }
+    printf("\"");
+}
+
+static void printRegs(int *regs, int n) {
+    printf("(");
+    for (int i = 0; i < n; i++) {
+        printf(i ? ", r%d" : "r%d", regs[i]);
+    }
+    printf(")");
+}
+
+static void dumpIR(Function *fn, IR *ir) {
+    printf("\t");
+    if (ir->r0) {
+        printf("r%d = ", ir->r0);
+    }
+    printf("%s", GetIRTypeName(ir->ty));
+
+    switch (ir->ty) {
+    case IR_IMM:
+        printf(" %d", ir->imm);
+        break;
+    case IR_BPREL:
+    case IR_LOAD_SPILL:
+        printf(" $%d", LocalIndex(fn, ir->ID));
+        break;
+    case IR_MOV:
+    case IR_RETURN:
+        if (ir->r2) printf(" r%d", ir->r2);
+        break;
+    case IR_NEG:
+        printf(" r%d", ir->r1);
+        break;
+    case IR_CALL:
+        printf(" %s", ir->Name);
+        printRegs(IRArgs(fn, ir), ir->NArgs);
+        break;
+    case IR_LABEL_ADDR:
+        printf(" %s", ir->Name);
+        break;
+    case IR_JMP:
+        printf(" .L%d", ir->bb1->Label);
+        if (ir->NBBArgs) printRegs(IRBBArgs(fn, ir), ir->NBBArgs);
+        break;
+    case IR_TEST:
+        printf(" r%d, .L%d, .L%d", ir->r2, ir->bb1->Label, ir->bb2->Label);
+        break;
+    case IR_LOAD:
+        printf(" r%d, %d", ir->r2, ir->Size);
+        break;
+    case IR_STORE:
+        printf(" r%d, r%d, %d", ir->r1, ir->r2, ir->Size);
+        break;
+    case IR_STORE_ARG:
+        printf(" $%d, %d, %d", LocalIndex(fn, ir->ID), ir->imm, ir->Size);
+        break;
+    case IR_LOAD_ARG:
+        printf(" %d, %d", ir->imm, ir->Size);
+        break;
+    case IR_STORE_SPILL:
+        printf(" $%d, r%d", LocalIndex(fn, ir->ID), ir->r1);
+        break;
+    case IR_NOP:
+        break;
+    default:
+        printf(" r%d, r%d", ir->r1, ir->r2);
+    }
+    printf("\n");
+}
+
+void DumpFunction(Function *fn) {
+    printf("func %s", fn->Name);
+    if (fn->Line) printf(" line %d", fn->Line);
+    printf("\n");
+    for (int i = 0; i < VectorSize(fn->LocalVars); i++) {
+        Var *var = VectorGet(fn->LocalVars, i);
+        printf("local $%d %d %d ", i, var->ty->Size, var->ty->Align);
+        printString(var->Name, strlen(var->Name));
+        printf("\n");
+    }
+
+    int line = 0;
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        printf(".L%d", bb->Label);
+        if (bb->Params.len) printRegs(IntVecData(&bb->Params), bb->Params.len);
+        printf(":\n");
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            if (ir->Line != line) {
+                line = ir->Line;
+                printf("\tline %d\n", line);
+            }
+            dumpIR(fn, ir);
+        }
+    }
+    printf("end\n");
+}
+
+void DumpIR(Program *prog) {
+    if (prog->File) {
+        printf("file ");
+        printString(prog->File, strlen(prog->File));
+        printf("\n");
+    }
+    for (int i = 0; i < VectorSize(prog->GlobalVars); i++) {
+        Var *var = VectorGet(prog->GlobalVars, i);
+        if (var->StringData) {
+            printf("string %s %d ", var->Name, var->ty->Size);
+            printString(var->StringData, var->ty->Size);
+        } else if (var->RawData) {
+            printf("data %s %d ", var->Name, var->ty->Size);
+            printString(var->RawData, var->RawDataSize);
+        } else {
+            printf("bss %s %d", var->Name, var->ty->Size);
+        }
+        printf("\n");
+    }
+
+    for (int i = 0; i < VectorSize(prog->Functions); i++) {
+        printf("\n");
+        DumpFunction(VectorGet(prog->Functions, i));
+    }
+}
+
+typedef struct IRReader {
+    char *chunkName;
+    char *pos;
+    int line;
+
+    Function *fn;
+    Vector *bbs;  // BB by label number
+} IRReader;
+
+static void Error(IRReader *r, char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "IR Error:\n");
+    fprintf(stderr, "File: %s, Line: %d.\n", r->chunkName, r->line);
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+static void skipSpace(IRReader *r) {
+    for (;;) {
+        if (*r->pos == '\n') {
+            r->line++;
+            r->pos++;
+        } else if (isspace(*r->pos)) {
+            r->pos++;
+        } else if (*r->pos == ';') {
+            while (*r->pos && *r->pos != '\n') r->pos++;
+        } else {
+            return;
+        }
+    }
+}
+
+static int accept(IRReader *r, char c) {
+    skipSpace(r);
+    if (*r->pos != c) return 0;
+    r->pos++;
+    return 1;
+}
+
+static void expect(IRReader *r, char c) {
+    if (!accept(r, c)) Error(r, "'%c' expected.", c);
+}
+
+static int isWordChar(char c) {
+    return isalnum(c) || c == '_' || c == '.' || c == '$';
+}
+
+static char *readWord(IRReader *r) {
+    skipSpace(r);
+    char *start = r->pos;
+    while (isWordChar(*r->pos)) r->pos++;
+    if (r->pos == start) Error(r, "unexpected character '%c'.", *r->pos);
+    return StringClone(start, r->pos - start);
+}
+
+static int readInt(IRReader *r) {
+    skipSpace(r);
+    char *end;
+    long val = strtol(r->pos, &end, 10);
+    if (end == r->pos) Error(r, "number expected.");
+    r->pos = end;
+    return val;
+}
+
+// Parses `<prefix><number>`, returning -1 if s is not of that form.
+static int numbered(char *s, char *prefix) {
+    int n = strlen(prefix);
+    if (strncmp(s, prefix, n) || !s[n]) return -1;
+    for (char *p = s + n; *p; p++) {
+        if (!isdigit(*p)) return -1;
+    }
+    return atoi(s + n);
+}
+
+// Returns the element i of v, growing v with NULLs as needed.
+static void **slot(Vector *v, int i) {
+    while (VectorSize(v) <= i) VectorPush(v, NULL);
+    return &v->data[i];
+}
+
+static int getReg(IRReader *r, char *word) {
+    int n = numbered(word, "r");
+    if (n <= 0) Error(r, "register expected, but found '%s'.", word);
+
+    while (r->fn->NRegs < n) AddReg(r->fn);
+    return n;
+}
+
+static int readReg(IRReader *r) {
+    return getReg(r, readWord(r));
+}
+
+static Var *readLocal(IRReader *r) {
+    char *word = readWord(r);
+    int n = numbered(word, "$");
+    if (n < 0 || n >= VectorSize(r->fn->LocalVars)) {
+        Error(r, "local variable expected, but found '%s'.", word);
+    }
+    return VectorGet(r->fn->LocalVars, n);
+}
+
+static BB *getBB(IRReader *r, char *word) {
+    int n = numbered(word, ".L");
+    if (n < 0) Error(r, "label expected, but found '%s'.", word);
+    if (n >= nLabel) nLabel = n + 1;
+
+    BB **bb = (BB **)slot(r->bbs, n);
+    if (!*bb) {
+        *bb = MemCalloc(MEM_BB, 1, sizeof(BB));
+        (*bb)->Label = n;
+    }
+    return *bb;
+}
+
+static BB *readBB(IRReader *r) {
+    return getBB(r, readWord(r));
+}
+
+static char *readString(IRReader *r, int *len) {
+    expect(r, '"');
+    StringBuilder *sb = NewStringBuilder();
+    while (*r->pos != '"') {
+        if (!*r->pos || *r->pos == '\n') Error(r, "unfinished string.");
+        if (*r->pos != '\\') {
+            StringBuilderAdd(sb, *r->pos++);
+            continue;
+        }
+        r->pos++;
+        if (isdigit(*r->pos)) {
+            int c = 0;
+            for (int i = 0; i < 3 && isdigit(*r->pos); i++) {
+                c = c * 8 + *r->pos++ - '0';
+            }
+            StringBuilderAdd(sb, c);
+        } else {
+            StringBuilderAdd(sb, *r->pos++);
+        }
+    }
+    r->pos++;
+    *len = sb->len;
+    return StringBuilderToString(sb);
+}
+
+// Reads an optional parenthesized list of registers into v.
+static void readRegs(IRReader *r, IntVec *v) {
+    if (!accept(r, '(')) return;
+    while (!accept(r, ')')) {
+        if (v->len > 0) expect(r, ',');
+        IntVecPush(v, readReg(r));
+    }
+}
+
+static IRType getIRType(IRReader *r, char *name) {
+    for (IRType ty = IR_ADD; ty <= IR_NOP; ty++) {
+        if (!strcmp(GetIRTypeName(ty), name)) return ty;
+    }
+    Error(r, "unknown instruction '%s'.", name);
+    return IR_ILLEGAL;
+}
+
+static void readIR(IRReader *r, BB *bb, int r0, char *name) {
+    IRVecPush(&bb->IRs, (IR){.ty = getIRType(r, name), .r0 = r0});
+    IR *ir = IRVecData(&bb->IRs) + bb->IRs.len - 1;
+
+    switch (ir->ty) {
+    case IR_IMM:
+        ir->imm = readInt(r);
+        break;
+    case IR_BPREL:
+    case IR_LOAD_SPILL:
+        ir->ID = readLocal(r);
+        break;
+    case IR_MOV:
+    case IR_RETURN:
+        ir->r2 = readReg(r);
+        break;
+    case IR_NEG:
+        ir->r1 = readReg(r);
+        break;
+    case IR_CALL:
+        ir->Name = readWord(r);
+        ir->Args = r->fn->Args.len;
+        expect(r, '(');
+        while (!accept(r, ')')) {
+            if (ir->NArgs > 0) expect(r, ',');
+            if (ir->NArgs == 6) Error(r, "too many arguments.");
+            IntVecPush(&r->fn->Args, readReg(r));
+            ir->NArgs++;
+        }
+        break;
+    case IR_LOAD_ARG:
+        ir->imm = readInt(r);
+        expect(r, ',');
+        ir->Size = readInt(r);
+        break;
+    case IR_LABEL_ADDR:
+        ir->Name = readWord(r);
+        break;
+    case IR_JMP: {
+        ir->bb1 = readBB(r);
+        IntVec args = {0};
+        readRegs(r, &args);
+        SetBBArgs(r->fn, ir, IntVecData(&args), args.len);
+        IntVecFree(&args);
+        break;
+    }
+    case IR_TEST:
+        ir->r2 = readReg(r);
+        expect(r, ',');
+        ir->bb1 = readBB(r);
+        expect(r, ',');
+        ir->bb2 = readBB(r);
+        break;
+    case IR_LOAD:
+        ir->r2 = readReg(r);
+        expect(r, ',');
+        ir->Size = readInt(r);
+        break;
+    case IR_STORE:
+        ir->r1 = readReg(r);
+        expect(r, ',');
+        ir->r2 = readReg(r);
+        expect(r, ',');
+        ir->Size = readInt(r);
+        break;
+    case IR_STORE_ARG:
+        ir->ID = readLocal(r);
+        expect(r, ',');
+        ir->imm = readInt(r);
+        expect(r, ',');
+        ir->Size = readInt(r);
+        break;
+    case IR_STORE_SPILL:
+        ir->ID = readLocal(r);
+        expect(r, ',');
+        ir->r1 = readReg(r);
+        break;
+    case IR_NOP:
+        break;
+    default:
+        ir->r1 = readReg(r);
+        expect(r, ',');
+        ir->r2 = readReg(r);
+    }
+}
+
+static Type *newDataType(int size, int align) {
+    Type *ty = NewType(ARRAY, size);
+    ty->Align = align;
+    return ty;
+}
+
+static void readLocalDecl(IRReader *r) {
+    Function *fn = r->fn;
+    char *word = readWord(r);
+    if (numbered(word, "$") != VectorSize(fn->LocalVars)) {
+        Error(r, "local variables must be numbered in order.");
+    }
+    int size = readInt(r);
+    int align = readInt(r);
+    int len;
+    char *name = readString(r, &len);
+    VectorPush(fn->LocalVars, NewVar(newDataType(size, align), name, 1));
+}
+
+static void readFunction(IRReader *r, Program *prog) {
+    Function *fn = NewFunction();
+    fn->Name = readWord(r);
+    fn->Params = NewVector();
+    fn->LocalVars = NewVector();
+    VectorPush(prog->Functions, fn);
+
+    r->fn = fn;
+    r->bbs = NewVector();
+
+    BB *bb = NULL;
+    int line = 0;
+    for (;;) {
+        char *word = readWord(r);
+        if (!strcmp(word, "end")) break;
+
+        if (!strcmp(word, "line")) {
+            // Before the first block, it is the line of the function.
+            if (bb) {
+                line = readInt(r);
+            } else {
+                fn->Line = readInt(r);
+            }
+            continue;
+        }
+
+        if (!strcmp(word, "local")) {
+            if (bb) Error(r, "local variables must precede the first block.");
+            readLocalDecl(r);
+            continue;
+        }
+
+        if (numbered(word, ".L") >= 0) {
+            bb = getBB(r, word);
+            if (BBVecContain(&fn->bbs, bb)) Error(r, "redefinition of '%s'.", word);
+            BBVecPush(&fn->bbs, bb);
+            readRegs(r, &bb->Params);
+            expect(r, ':');
+            continue;
+        }
+
+        if (!bb) Error(r, "instruction outside of a block.");
+
+        int r0 = 0;
+        if (numbered(word, "r") >= 0) {
+            r0 = getReg(r, word);
+            expect(r, '=');
+            word = readWord(r);
+        }
+        readIR(r, bb, r0, word);
+        IRVecData(&bb->IRs)[bb->IRs.len - 1].Line = line;
+    }
+
+    for (int i = 0; i < VectorSize(r->bbs); i++) {
+        BB *bb = VectorGet(r->bbs, i);
+        if (bb && !BBVecContain(&fn->bbs, bb)) {
+            Error(r, "undefined label '.L%d' in function '%s'.", bb->Label, fn->Name);
+        }
+    }
+}
+
+Program *ReadIR(char *chunkName, char *chunk) {
+    IRReader *r = MemCalloc(MEM_OTHER, 1, sizeof(IRReader));
+    r->chunkName = chunkName;
+    r->pos = chunk;
+    r->line = 1;
+
+    Program *prog = NewProgram();
+    prog->macros = NewMap();
+
+    for (skipSpace(r); *r->pos; skipSpace(r)) {
+        char *word = readWord(r);
+        if (!strcmp(word, "func")) {
+            readFunction(r, prog);
+            continue;
+        }
+
+        if (!strcmp(word, "file")) {
+            int len;
+            prog->File = readString(r, &len);
+            continue;
+        }
+
+        Var *var;
+        if (!strcmp(word, "string")) {
+            char *name = readWord(r);
+            int size = readInt(r), len;
+            var = NewVar(newDataType(size, 1), name, 0);
+            var->StringData = readString(r, &len);
+            if (len != size) Error(r, "string length mismatch.");
+        } else if (!strcmp(word, "data")) {
+            char *name = readWord(r);
+            int size = readInt(r);
+            var = NewVar(newDataType(size, 1), name, 0);
+            var->RawData = readString(r, &var->RawDataSize);
+        } else if (!strcmp(word, "bss")) {
+            char *name = readWord(r);
+            var = NewVar(newDataType(readInt(r), 1), name, 0);
+        } else {
+            Error(r, "unexpected '%s'.", word);
+        }
+        VectorPush(prog->GlobalVars, var);
+    }
+    return prog;
+}
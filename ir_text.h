@@ -0,0 +1,15 @@
+#ifndef IR_TEXT_H
+#define IR_TEXT_H
+
+#include "ir.h"
+
+// Textual form of the IR, as produced by GenProgram.
+//
+// DumpIR prints a program to stdout and ReadIR parses that output
+// back, so the backend (Analyze, Allocate and Genx86) can be run on
+// captured IR without the front end.
+void DumpFunction(Function *fn);
+void DumpIR(Program *prog);
+Program *ReadIR(char *chunkName, char *chunk);
+
+#endif
@@ -5,6 +5,8 @@
 #include <ctype.h>
 #include <assert.h>
 #include "lexer.h"
+#include "mem.h"
+#include "timer.h"
 
 static char escaped[256] = {
     ['0'] = '\0',
@@ -42,7 +44,7 @@ static void ErrorAt(Lexer *lexer, char *loc, char *fmt, ...) {
 }
 
 Lexer *NewLexer(char *chunkName, char *chunk) {
-    Lexer *lexer = calloc(1, sizeof(Lexer));
+    Lexer *lexer = MemCalloc(MEM_OTHER, 1, sizeof(Lexer));
     lexer->chunkName = StringClone(chunkName, strlen(chunkName));
     lexer->chunkSize = strlen(chunk);
     lexer->chunk = StringClone(chunk, lexer->chunkSize);
@@ -139,7 +141,7 @@ char *mustReadChar(Lexer *lexer) {
 char *readUntilChar(Lexer *lexer, char *tpl) {
     //KMP
     int tlen = strlen(tpl);
-    int *f = malloc(sizeof(int) * (tlen + 1));
+    int *f = MemMalloc(MEM_OTHER, sizeof(int) * (tlen + 1));
     f[0] = f[1] = 0;
     for (int i = 1, j = 0; i < tlen; i++) {
 		while (j && tpl[i] != tpl[j]) j = f[j];
@@ -150,8 +152,12 @@ char *readUntilChar(Lexer *lexer, char *tpl) {
     for (int j = 0; ch != NULL; ch = readChar(lexer)) {
 		while (j && *ch != tpl[j]) j = f[j];
 		j += *ch == tpl[j];
-		if (j == tlen) return ch - tlen + 2;
+		if (j == tlen) {
+            MemFree(f);
+            return ch - tlen + 2;
+        }
 	}
+    MemFree(f);
     return ch;
 }
 
@@ -166,7 +172,7 @@ char *readCharConst(Lexer *lexer) {
             }
             ch = mustReadChar(lexer);
         }
-        char *c = malloc(1);
+        char *c = MemMalloc(MEM_STRING, 1);
         *c = escaped[*(startPos + 1)];
         return c;
     } else {
@@ -510,6 +516,8 @@ Token *parseToken(Lexer *lexer) {
 }
 
 Token *nextToken(Lexer *lexer) {
+    TimerBegin(PHASE_LEX);
+
     // preprocess
     Token *token = parseToken(lexer);
     while (token->Type == TOKEN_PREOP) {
@@ -555,6 +563,7 @@ Token *nextToken(Lexer *lexer) {
             }
         }
     }
+    TimerEnd(NULL);
     return token;
 }
 
@@ -0,0 +1,319 @@
+// Loop-invariant code motion.
+//
+// Loops are visited inner ones first. An instruction of a loop is
+// invariant if it computes the same value on every iteration: an
+// immediate, the address of a local or global, or arithmetic whose
+// operands are defined outside the loop or by invariant instructions.
+// Such instructions are moved to the end of the preheader, the block
+// jumping to the header from outside the loop, which is created when
+// the header is entered from several blocks or by a branch. Moving
+// them in the order they are found keeps definitions before uses.
+//
+// A load is invariant if its address is and no store or call in the
+// loop may write there, as alias.c tells. Unlike arithmetic, a load
+// may fault, and the preheader runs even if the loop body doesn't: a
+// load is only moved if it is in the header, which runs whenever the
+// preheader does, or reads a local or global at the address of the
+// variable itself. Divisions may fault too and are only moved from
+// the header.
+//
+// A block made by an inner loop belongs to the loop around it, so
+// what was moved out of the inner loop may be moved again.
+#include "licm.h"
+#include "alias.h"
+#include "cfg.h"
+#include "mem.h"
+#include "pass.h"
+#include "remark.h"
+
+extern int nLabel;
+
+// Where a store in a loop writes.
+typedef struct Write {
+    int base; // BASE_*
+    void *obj;
+} Write;
+
+DEFINE_STRUCT_VEC(WriteVec, Write, MEM_OTHER)
+
+// What is written to memory in a loop.
+typedef struct Writes {
+    WriteVec stores;
+    int calls;
+} Writes;
+
+typedef struct LICM {
+    Function *fn;
+    DefUse *du;
+    AliasInfo *ai;
+    BB **defBB;  // per register: the block defining it, or NULL
+    int *defTy;  // per register: the type of the instruction defining it, or -1
+    int hoisted;
+} LICM;
+
+static int inLoop(BB *bb, Loop *loop) {
+    for (Loop *l = bb->Loop; l; l = l->Parent) {
+        if (l == loop) return 1;
+    }
+    return 0;
+}
+
+// Returns the line of the first instruction of bb that has one.
+static int blockLine(BB *bb) {
+    for (int i = 0; i < bb->IRs.len; i++) {
+        int line = IRVecData(&bb->IRs)[i].Line;
+        if (line) return line;
+    }
+    return 0;
+}
+
+static void findDefs(LICM *m) {
+    Function *fn = m->fn;
+    for (int i = 0; i <= fn->NRegs; i++) m->defTy[i] = -1;
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        for (int i = 0; i < bb->Params.len; i++) m->defBB[IntVecGet(&bb->Params, i)] = bb;
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            if (!ir->r0) continue;
+            m->defBB[ir->r0] = bb;
+            m->defTy[ir->r0] = ir->ty;
+        }
+    }
+}
+
+static void findWrites(LICM *m, Loop *loop, Writes *w) {
+    AliasInfo *ai = m->ai;
+    for (int i = 0; i < loop->Blocks.len; i++) {
+        BB *bb = BBVecGet(&loop->Blocks, i);
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            if (ir->ty == IR_STORE) {
+                WriteVecPush(&w->stores, (Write){ai->Base[ir->r1], ai->Obj[ir->r1]});
+            } else if (ir->ty == IR_STORE_ARG) {
+                WriteVecPush(&w->stores, (Write){BASE_LOCAL, ir->ID});
+            } else if (ir->ty == IR_CALL) {
+                w->calls++;
+            }
+        }
+    }
+}
+
+// Returns whether r has the same value on every iteration of loop.
+static int isInvariant(LICM *m, Loop *loop, int r) {
+    if (m->du->Def[r] == DEF_MANY) return 0;
+    return !m->defBB[r] || !inLoop(m->defBB[r], loop);
+}
+
+// Returns why the load ir in bb can't be moved out of loop, or NULL.
+static char *loadBlocker(LICM *m, Loop *loop, BB *bb, IR *ir, Writes *w) {
+    AliasInfo *ai = m->ai;
+    int base = ai->Base[ir->r2];
+    void *obj = ai->Obj[ir->r2];
+    for (int i = 0; i < w->stores.len; i++) {
+        Write st = WriteVecGet(&w->stores, i);
+        if (MayAlias(ai, base, obj, st.base, st.obj))
+            return "a store in the loop may write its address";
+    }
+    if (w->calls && MayEscape(ai, base, obj)) return "a call in the loop may write its address";
+    int ty = m->defTy[ir->r2];
+    if (bb != loop->Header && ty != IR_BPREL && ty != IR_LABEL_ADDR)
+        return "it may not run when the loop is entered";
+    return NULL;
+}
+
+static int canHoist(LICM *m, Loop *loop, BB *bb, IR *ir, Writes *w) {
+    if (!ir->r0 || m->du->Def[ir->r0] == DEF_MANY) return 0;
+    if (ir->r1 && !isInvariant(m, loop, ir->r1)) return 0;
+    if (ir->r2 && !isInvariant(m, loop, ir->r2)) return 0;
+    switch (ir->ty) {
+    case IR_IMM:
+    case IR_BPREL:
+    case IR_LABEL_ADDR:
+    case IR_MOV:
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_AND:
+    case IR_OR:
+    case IR_XOR:
+    case IR_SHL:
+    case IR_SHR:
+    case IR_EQ:
+    case IR_NE:
+    case IR_LE:
+    case IR_LT:
+    case IR_NEG:
+        return 1;
+    case IR_DIV:
+    case IR_MOD:
+        return bb == loop->Header;
+    case IR_LOAD:
+        return !loadBlocker(m, loop, bb, ir, w);
+    default:
+        return 0;
+    }
+}
+
+// Returns whether the header of loop has a predecessor outside it,
+// which it lacks if it is the entry.
+static int enteredFromOutside(Loop *loop) {
+    for (int i = 0; i < loop->Header->Pred.len; i++) {
+        if (!inLoop(BBVecGet(&loop->Header->Pred, i), loop)) return 1;
+    }
+    return 0;
+}
+
+// Returns the block that only jumps to the header of loop from
+// outside, making one if there is none.
+static BB *preheader(LICM *m, Loop *loop) {
+    Function *fn = m->fn;
+    BB *header = loop->Header;
+    BB *outside = NULL;
+    int n = 0;
+    for (int i = 0; i < header->Pred.len; i++) {
+        BB *pred = BBVecGet(&header->Pred, i);
+        if (inLoop(pred, loop)) continue;
+        outside = pred;
+        n++;
+    }
+    if (n == 1 && outside->Succ.len == 1 && IRVecLast(&outside->IRs).ty == IR_JMP) return outside;
+
+    BB *pre = MemCalloc(MEM_BB, 1, sizeof(BB));
+    pre->Label = nLabel++;
+    pre->RPO = -1;
+    pre->Loop = loop->Parent;
+    for (Loop *l = loop->Parent; l; l = l->Parent) BBVecPush(&l->Blocks, pre);
+
+    // Lay it out just before the header, so that it falls through.
+    BBVecPush(&fn->bbs, pre);
+    int at = fn->bbs.len - 1;
+    while (BBVecGet(&fn->bbs, at - 1) != header) {
+        BBVecSet(&fn->bbs, at, BBVecGet(&fn->bbs, at - 1));
+        at--;
+    }
+    BBVecSet(&fn->bbs, at, header);
+    BBVecSet(&fn->bbs, at - 1, pre);
+
+    IR jmp = {.ty = IR_JMP, .bb1 = header, .Line = blockLine(header)};
+    IntVec args = {0};
+    for (int i = 0; i < header->Params.len; i++) {
+        int r = AddReg(fn);
+        IntVecPush(&pre->Params, r);
+        IntVecPush(&args, r);
+    }
+    SetBBArgs(fn, &jmp, IntVecData(&args), args.len);
+    IntVecFree(&args);
+    IRVecPush(&pre->IRs, jmp);
+
+    // Move the edges from outside to the preheader, so that the loops
+    // visited after this one see it in the CFG.
+    int npred = 0;
+    for (int i = 0; i < header->Pred.len; i++) {
+        BB *pred = BBVecGet(&header->Pred, i);
+        if (inLoop(pred, loop)) {
+            BBVecSet(&header->Pred, npred++, pred);
+            continue;
+        }
+        IR *last = IRVecData(&pred->IRs) + pred->IRs.len - 1;
+        if (last->bb1 == header) last->bb1 = pre;
+        if (last->bb2 == header) last->bb2 = pre;
+        for (int j = 0; j < pred->Succ.len; j++) {
+            if (BBVecGet(&pred->Succ, j) == header) BBVecSet(&pred->Succ, j, pre);
+        }
+        BBVecPush(&pre->Pred, pred);
+    }
+    header->Pred.len = npred;
+    BBVecPush(&header->Pred, pre);
+    BBVecPush(&pre->Succ, header);
+    return pre;
+}
+
+// Moves the invariant instructions of loop to its preheader and
+// returns their number.
+static int hoistLoop(LICM *m, Loop *loop) {
+    Writes w = {0};
+    findWrites(m, loop, &w);
+
+    BB *pre = NULL;
+    int n = 0;
+    for (int again = 1; again;) {
+        again = 0;
+        for (int i = 0; i < loop->Blocks.len; i++) {
+            BB *bb = BBVecGet(&loop->Blocks, i);
+            IRCursor c;
+            IROpen(&c, bb);
+            for (IR *ir; (ir = IRCur(&c));) {
+                if (!canHoist(m, loop, bb, ir, &w)) {
+                    IRNext(&c);
+                    continue;
+                }
+                if (!pre) pre = preheader(m, loop);
+                IR jmp = IRVecPop(&pre->IRs);
+                IRVecPush(&pre->IRs, *ir);
+                IRVecPush(&pre->IRs, jmp);
+                m->defBB[ir->r0] = pre;
+                IRErase(&c);
+                n++;
+                again = 1;
+            }
+            IRClose(&c);
+        }
+    }
+
+    // Say why the loads from invariant addresses left in the loop, and
+    // not in an inner one, stay.
+    for (int i = 0; i < loop->Blocks.len; i++) {
+        BB *bb = BBVecGet(&loop->Blocks, i);
+        if (bb->Loop != loop) continue;
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            if (ir->ty != IR_LOAD || !isInvariant(m, loop, ir->r2)) continue;
+            char *why = loadBlocker(m, loop, bb, ir, &w);
+            if (why) Remark(REMARK_MISSED, "licm", ir->Line, "load not hoisted out of the loop: %s", why);
+        }
+    }
+
+    WriteVecFree(&w.stores);
+    return n;
+}
+
+// Moves the loop-invariant instructions of fn out of their loops.
+int HoistInvariants(Function *fn) {
+    Require(fn, ANALYSIS_CFG);
+    int changed = RemoveUnreachable(fn);
+    Require(fn, ANALYSIS_LOOPS);
+
+    LICM m = {0};
+    m.fn = fn;
+    m.du = NewDefUse(fn);
+    m.ai = NewAliasInfo(fn, m.du);
+    m.defBB = MemCalloc(MEM_OTHER, fn->NRegs + 1, sizeof(BB *));
+    m.defTy = MemMalloc(MEM_OTHER, sizeof(int) * (fn->NRegs + 1));
+    findDefs(&m);
+
+    int nblocks = fn->bbs.len;
+    for (int i = 0; i < VectorSize(fn->Loops); i++) {
+        Loop *loop = VectorGet(fn->Loops, i);
+        int line = blockLine(loop->Header);
+        if (!enteredFromOutside(loop)) {
+            Remark(REMARK_MISSED, "licm", line, "loop not optimized: it starts the function, leaving no preheader");
+            continue;
+        }
+        int n = hoistLoop(&m, loop);
+        if (n) {
+            Remark(REMARK_PASS, "licm", line, "hoisted %d loop-invariant instruction%s out of the loop", n,
+                   n == 1 ? "" : "s");
+        } else {
+            Remark(REMARK_MISSED, "licm", line, "loop not optimized: nothing in it is loop-invariant");
+        }
+        m.hoisted += n;
+    }
+
+    MemFree(m.defTy);
+    MemFree(m.defBB);
+    FreeAliasInfo(m.ai);
+    FreeDefUse(m.du);
+    if (fn->bbs.len != nblocks) Invalidate(fn, ANALYSIS_CFG);
+    return changed || m.hoisted;
+}
@@ -0,0 +1,201 @@
+// Redundant load elimination.
+//
+// Walks each block keeping the values known to be in memory: what was
+// stored to an address or loaded from it last. A load of an address
+// with a known value of its size is removed and its result replaced
+// by that value. A store forgets the values at the addresses it may
+// write, and a call those at the addresses it may reach, as alias.c
+// tells. A block with a single predecessor laid out before it starts
+// with the values known at the end of that predecessor.
+#include "loadelim.h"
+#include "alias.h"
+#include "cfg.h"
+#include "mem.h"
+#include "pass.h"
+
+// The most values kept; more are rarely reused before a store or
+// call.
+#define MAX_AVAIL 32
+
+enum {
+    FITS_BYTE = 1, // 0..255, as a load of a char gives
+    FITS_INT = 2,  // a sign-extended int, as a load of an int gives
+};
+
+// A value known to be at an address.
+typedef struct Avail {
+    int addr;
+    int size;
+    int val;
+} Avail;
+
+DEFINE_STRUCT_VEC(AvailVec, Avail, MEM_OTHER)
+
+typedef struct LoadElim {
+    Function *fn;
+    DefUse *du;
+    AliasInfo *ai;
+    char *fits;     // per register: FITS_* its value is known to satisfy
+    int *subst;     // per register: the register replacing it, or 0
+    AvailVec *out;  // per block, by reverse postorder number
+    int removed;
+} LoadElim;
+
+static int isSSA(LoadElim *e, int r) {
+    return e->du->Def[r] != DEF_MANY;
+}
+
+// Finds the ranges of the values of the registers.
+static void findRanges(LoadElim *e) {
+    Function *fn = e->fn;
+    for (int i = 0; i < fn->RPO.len; i++) {
+        BB *bb = BBVecGet(&fn->RPO, i);
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            int r0 = ir->r0;
+            if (!r0 || !isSSA(e, r0)) continue;
+            switch (ir->ty) {
+            case IR_MOV:
+                e->fits[r0] = e->fits[ir->r2];
+                break;
+            case IR_IMM:
+                e->fits[r0] = FITS_INT | (ir->imm >= 0 && ir->imm <= 255 ? FITS_BYTE : 0);
+                break;
+            case IR_EQ:
+            case IR_NE:
+            case IR_LE:
+            case IR_LT:
+                e->fits[r0] = FITS_INT | FITS_BYTE;
+                break;
+            case IR_LOAD:
+            case IR_LOAD_ARG:
+                if (ir->Size == 1) e->fits[r0] = FITS_INT | FITS_BYTE;
+                if (ir->Size == 4) e->fits[r0] = FITS_INT;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+// Forgets the values at addresses that may be in the object.
+static void clobber(LoadElim *e, AvailVec *s, int base, void *obj) {
+    int n = 0;
+    for (int i = 0; i < s->len; i++) {
+        Avail a = AvailVecGet(s, i);
+        if (!MayAlias(e->ai, e->ai->Base[a.addr], e->ai->Obj[a.addr], base, obj)) AvailVecSet(s, n++, a);
+    }
+    s->len = n;
+}
+
+// Forgets the values a call may change.
+static void clobberCall(LoadElim *e, AvailVec *s) {
+    int n = 0;
+    for (int i = 0; i < s->len; i++) {
+        Avail a = AvailVecGet(s, i);
+        if (!MayEscape(e->ai, e->ai->Base[a.addr], e->ai->Obj[a.addr])) AvailVecSet(s, n++, a);
+    }
+    s->len = n;
+}
+
+static void remember(LoadElim *e, AvailVec *s, int addr, int size, int val) {
+    if (!isSSA(e, addr) || !isSSA(e, val)) return;
+    if (s->len == MAX_AVAIL) {
+        for (int i = 1; i < s->len; i++) AvailVecSet(s, i - 1, AvailVecGet(s, i));
+        s->len--;
+    }
+    AvailVecPush(s, (Avail){addr, size, val});
+}
+
+// Returns whether storing val with size bytes and loading it back
+// gives val.
+static int storesExactly(LoadElim *e, int val, int size) {
+    if (size == 8) return 1;
+    return e->fits[val] & (size == 1 ? FITS_BYTE : FITS_INT);
+}
+
+static int rename(LoadElim *e, int r) {
+    return e->subst[r] ? e->subst[r] : r;
+}
+
+static void eliminateBB(LoadElim *e, BB *bb, AvailVec *s) {
+    Function *fn = e->fn;
+    IRCursor c;
+    IROpen(&c, bb);
+    for (IR *ir; (ir = IRCur(&c));) {
+        if (ir->r1) ir->r1 = rename(e, ir->r1);
+        if (ir->r2) ir->r2 = rename(e, ir->r2);
+        if (ir->ty == IR_CALL) {
+            for (int i = 0; i < ir->NArgs; i++) IRArgs(fn, ir)[i] = rename(e, IRArgs(fn, ir)[i]);
+        }
+        if (ir->ty == IR_JMP) {
+            for (int i = 0; i < ir->NBBArgs; i++) IRBBArgs(fn, ir)[i] = rename(e, IRBBArgs(fn, ir)[i]);
+        }
+
+        switch (ir->ty) {
+        case IR_LOAD: {
+            int val = 0;
+            for (int i = 0; i < s->len; i++) {
+                Avail a = AvailVecGet(s, i);
+                if (a.addr == ir->r2 && a.size == ir->Size) val = a.val;
+            }
+            if (val && isSSA(e, ir->r0)) {
+                e->subst[ir->r0] = val;
+                e->removed++;
+                IRErase(&c);
+                continue;
+            }
+            remember(e, s, ir->r2, ir->Size, ir->r0);
+            break;
+        }
+        case IR_STORE:
+            clobber(e, s, e->ai->Base[ir->r1], e->ai->Obj[ir->r1]);
+            if (storesExactly(e, ir->r2, ir->Size)) remember(e, s, ir->r1, ir->Size, ir->r2);
+            break;
+        case IR_STORE_ARG:
+            clobber(e, s, BASE_LOCAL, ir->ID);
+            break;
+        case IR_CALL:
+            clobberCall(e, s);
+            break;
+        default:
+            break;
+        }
+        IRNext(&c);
+    }
+    IRClose(&c);
+}
+
+// Removes the loads of fn whose value is known.
+int EliminateLoads(Function *fn) {
+    Require(fn, ANALYSIS_CFG);
+    int changed = RemoveUnreachable(fn);
+
+    LoadElim e = {0};
+    e.fn = fn;
+    e.du = NewDefUse(fn);
+    e.ai = NewAliasInfo(fn, e.du);
+    e.fits = MemCalloc(MEM_OTHER, fn->NRegs + 1, 1);
+    e.subst = MemCalloc(MEM_OTHER, fn->NRegs + 1, sizeof(int));
+    e.out = MemCalloc(MEM_OTHER, fn->RPO.len, sizeof(AvailVec));
+    findRanges(&e);
+
+    for (int i = 0; i < fn->RPO.len; i++) {
+        BB *bb = BBVecGet(&fn->RPO, i);
+        AvailVec *s = &e.out[i];
+        if (bb->Pred.len == 1 && BBVecGet(&bb->Pred, 0)->RPO < i) {
+            AvailVec *in = &e.out[BBVecGet(&bb->Pred, 0)->RPO];
+            for (int i = 0; i < in->len; i++) AvailVecPush(s, AvailVecGet(in, i));
+        }
+        eliminateBB(&e, bb, s);
+    }
+
+    for (int i = 0; i < fn->RPO.len; i++) AvailVecFree(&e.out[i]);
+    MemFree(e.out);
+    MemFree(e.subst);
+    MemFree(e.fits);
+    FreeAliasInfo(e.ai);
+    FreeDefUse(e.du);
+    return changed || e.removed;
+}
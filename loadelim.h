@@ -0,0 +1,8 @@
+#ifndef LOADELIM_H
+#define LOADELIM_H
+
+#include "ir.h"
+
+int EliminateLoads(Function *fn);
+
+#endif
@@ -1,35 +1,146 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "lexer.h"
 #include "parser.h"
 #include "generator.h"
 #include "analyzer.h"
 #include "allocator.h"
 #include "gen_x86.h"
+#include "ir_text.h"
+#include "ir_binary.h"
+#include "mem.h"
+#include "pass.h"
+#include "remark.h"
+#include "stats.h"
+#include "timer.h"
 #include "ast.h"
 
+char *readFile(char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open file '%s' for reading\n", path);
+        exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    long flen = ftell(fp);
+    char *chunk = MemMalloc(MEM_BUFFER, flen + 1);
+    fseek(fp, 0L, SEEK_SET);
+    fread(chunk, flen, 1, fp);
+    chunk[flen] = 0;
+    fclose(fp);
+    return chunk;
+}
+
+void usage() {
+    printf("xacc 0.3.2 2020.11.14 Copyright (C) 2020 xaxys.\n");
+    printf("usage: xacc [options] [file]\n");
+    printf("options:\n");
+    printf("  -emit-ir        print the IR instead of assembly\n");
+    printf("  -emit-irbin     write the IR as a binary module instead of assembly\n");
+    printf("  -x c|ir|irbin   treat the input file as C source, textual IR or an IR module\n");
+    printf("  -O0|-O1|-O2     set the optimization level (default -O1)\n");
+    printf("  -passes=a,b,... run the given passes instead of those of the level\n");
+    printf("  -ftime-report   print the time spent in each compiler phase\n");
+    printf("  -ftrace=FILE    write a Chrome trace of the phases run on each function\n");
+    printf("  -fmem-report    print memory allocated by each part of the compiler\n");
+    printf("  -stats=json     print per-function statistics as JSON\n");
+    printf("  -Rpass[=pass]   report the optimizations done by a pass or all passes\n");
+    printf("  -Rpass-missed[=pass]\n");
+    printf("                  report the optimizations a pass or all passes could not do\n");
+}
+
 int main(int argc, char *argv[]) {
-    if (argc == 2) {
-        FILE *fp = fopen(argv[1], "r");
-        if (fp == NULL) 
-            fprintf(stderr, "Failed to open file '%s' for reading", argv[1]);
-        fseek(fp, 0, SEEK_END);
-        long flen = ftell(fp);
-        char *chunk = malloc(flen + 1);
-        fseek(fp, 0L, SEEK_SET);
-        fread(chunk, flen, 1, fp);
-        chunk[flen] = 0;
-
-        Lexer *lexer = NewLexer(argv[1], chunk);
+    char *path = NULL;
+    int emitIR = 0;
+    int emitIRBinary = 0;
+    int inputIR = 0;
+    int inputIRBinary = 0;
+    Vector *pipeline = PipelineForLevel(1);
+    int explicitPasses = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-emit-ir")) {
+            emitIR = 1;
+        } else if (!strcmp(argv[i], "-emit-irbin")) {
+            emitIRBinary = 1;
+        } else if (!strcmp(argv[i], "-x") && i + 1 < argc) {
+            char *lang = argv[++i];
+            inputIR = !strcmp(lang, "ir");
+            inputIRBinary = !strcmp(lang, "irbin");
+            if (!inputIR && !inputIRBinary && strcmp(lang, "c")) {
+                fprintf(stderr, "Unknown language '%s'\n", lang);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "-O0") || !strcmp(argv[i], "-O1") || !strcmp(argv[i], "-O2")) {
+            pipeline = PipelineForLevel(argv[i][2] - '0');
+            explicitPasses = 0;
+        } else if (!strncmp(argv[i], "-passes=", 8)) {
+            pipeline = ParsePipeline(argv[i] + 8);
+            explicitPasses = 1;
+        } else if (!strcmp(argv[i], "-ftime-report")) {
+            TimeReport = 1;
+        } else if (!strcmp(argv[i], "-fmem-report")) {
+            atexit(PrintMemReport);
+        } else if (!strcmp(argv[i], "-Rpass") || !strncmp(argv[i], "-Rpass=", 7)) {
+            EnableRemarks(REMARK_PASS, argv[i][6] ? argv[i] + 7 : NULL);
+        } else if (!strcmp(argv[i], "-Rpass-missed") || !strncmp(argv[i], "-Rpass-missed=", 14)) {
+            EnableRemarks(REMARK_MISSED, argv[i][13] ? argv[i] + 14 : NULL);
+        } else if (!strcmp(argv[i], "-stats=json")) {
+            StatsEnabled = 1;
+            atexit(PrintStats);
+        } else if (!strncmp(argv[i], "-ftrace=", 8)) {
+            StartTrace(argv[i] + 8);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+            return 1;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (!path) {
+        printf("Oops! No input files given.\n");
+        usage();
+        return 0;
+    }
+
+    atexit(FinishTimers);
+    RemarkFile = path;
+
+    // Assembly and IR dumps are written through stdout.
+    setvbuf(stdout, MemMalloc(MEM_BUFFER, 1 << 16), _IOFBF, 1 << 16);
+
+    // IR read back is compiled as it was captured, so that the backend
+    // can be measured alone, unless passes are asked for by name.
+    if ((inputIR || inputIRBinary) && !explicitPasses) pipeline = PipelineForLevel(0);
+
+    Program *program;
+    if (inputIRBinary) {
+        program = LoadIRModule(MapIRModule(path));
+    } else if (inputIR) {
+        program = ReadIR(path, readFile(path));
+    } else {
+        Lexer *lexer = NewLexer(path, readFile(path));
         Parser *parser = NewParser(lexer);
-        Program *program = ParseProgram(parser);
+        program = ParseProgram(parser);
         GenProgram(program);
-        Analyze(program);
-        Allocate(program);
-        Genx86(program);
-    } else {
-        printf("Oops! No input files given.\n");
-		printf("xacc 0.3.2 2020.11.14 Copyright (C) 2020 xaxys.\n");
-		printf("usage: xacc [file]\n");
     }
-}
\ No newline at end of file
+
+    RunPasses(program, pipeline, 0);
+
+    if (emitIR) {
+        DumpIR(program);
+        return 0;
+    }
+
+    if (emitIRBinary) {
+        WriteIRBinary(program, stdout);
+        return 0;
+    }
+
+    Analyze(program);
+    Allocate(program);
+    RunPasses(program, pipeline, 1);
+    Genx86(program);
+}
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "mem.h"
+
+typedef union Header {
+    struct {
+        size_t size;
+        MemOwner owner;
+    };
+    max_align_t align;
+} Header;
+
+typedef struct MemStat {
+    long count;
+    long bytes;
+    long live;
+    long peak;
+} MemStat;
+
+static char *ownerNames[] = {
+    "tokens", "ast", "types", "ir", "registers", "blocks",
+    "vectors", "maps", "bitsets", "strings", "buffers", "other",
+};
+
+static MemStat stats[NUM_MEM_OWNERS];
+static long live, peak;
+
+static void outOfMemory(size_t size) {
+    fprintf(stderr, "Out of memory allocating %zu bytes\n", size);
+    exit(1);
+}
+
+static void account(MemOwner owner, long size) {
+    MemStat *s = &stats[owner];
+    s->live += size;
+    if (s->live > s->peak) s->peak = s->live;
+    live += size;
+    if (live > peak) peak = live;
+}
+
+void *MemMalloc(MemOwner owner, size_t size) {
+    Header *h = malloc(sizeof(Header) + size);
+    if (!h) outOfMemory(size);
+    h->size = size;
+    h->owner = owner;
+    stats[owner].count++;
+    stats[owner].bytes += size;
+    account(owner, size);
+    return h + 1;
+}
+
+void *MemCalloc(MemOwner owner, size_t n, size_t size) {
+    void *p = MemMalloc(owner, n * size);
+    memset(p, 0, n * size);
+    return p;
+}
+
+void *MemRealloc(void *p, size_t size) {
+    Header *h = (Header *)p - 1;
+    MemOwner owner = h->owner;
+    long old = h->size;
+
+    h = realloc(h, sizeof(Header) + size);
+    if (!h) outOfMemory(size);
+    h->size = size;
+    if (size > old) stats[owner].bytes += size - old;
+    account(owner, (long)size - old);
+    return h + 1;
+}
+
+void MemFree(void *p) {
+    if (!p) return;
+    Header *h = (Header *)p - 1;
+    account(h->owner, -(long)h->size);
+    free(h);
+}
+
+void PrintMemReport() {
+    fprintf(stderr, "Memory usage\n");
+    fprintf(stderr, "  %-10s %10s %12s %12s\n", "owner", "allocs", "bytes", "peak live");
+
+    MemStat total = {0};
+    for (int i = 0; i < NUM_MEM_OWNERS; i++) {
+        MemStat *s = &stats[i];
+        fprintf(stderr, "  %-10s %10ld %12ld %12ld\n", ownerNames[i], s->count, s->bytes, s->peak);
+        total.count += s->count;
+        total.bytes += s->bytes;
+    }
+    fprintf(stderr, "  %-10s %10ld %12ld %12ld\n", "total", total.count, total.bytes, peak);
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    fprintf(stderr, "  peak RSS: %ld KiB\n", ru.ru_maxrss);
+}
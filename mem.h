@@ -0,0 +1,34 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+
+// Accounting allocator for -fmem-report.
+//
+// Each block carries a small header recording its size and the
+// subsystem that owns it, so frees and reallocs are charged to the
+// owner the block was allocated for.
+
+typedef enum MemOwner {
+    MEM_TOKEN,
+    MEM_AST,
+    MEM_TYPE,
+    MEM_IR,
+    MEM_REG,
+    MEM_BB,
+    MEM_VECTOR,
+    MEM_MAP,
+    MEM_BITSET,
+    MEM_STRING,
+    MEM_BUFFER,
+    MEM_OTHER,
+    NUM_MEM_OWNERS,
+} MemOwner;
+
+void *MemMalloc(MemOwner owner, size_t size);
+void *MemCalloc(MemOwner owner, size_t n, size_t size);
+void *MemRealloc(void *p, size_t size);
+void MemFree(void *p);
+void PrintMemReport();
+
+#endif
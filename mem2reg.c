@@ -0,0 +1,512 @@
+// Promotion of local variables to registers.
+//
+// A local can live in registers when its address is only ever used
+// to load or store the whole local, i.e. when every result of a bprel
+// of it is the address operand of a load or store of its size. The
+// loads and stores of such locals are replaced by SSA registers with
+// the algorithm of Cytron et al.: block parameters are placed on the
+// iterated dominance frontier of the stores, pruned to the blocks on
+// entry to which the local is live, and a walk of the dominator tree
+// replaces each load by the value stored last.
+#include <assert.h>
+#include "mem2reg.h"
+#include "cfg.h"
+#include "mem.h"
+#include "pass.h"
+#include "remark.h"
+
+extern int nLabel;
+
+enum {
+    LOCAL_PROMOTED,
+    LOCAL_ESCAPES,    // its address is used otherwise
+    LOCAL_NOT_SCALAR, // it is not loaded and stored as a whole
+};
+
+typedef struct Promoter {
+    Function *fn;
+    int nvars;
+    Var **vars;      // fn->LocalVars on entry
+    int *state;      // per local
+    int *line;       // per local: line of its first reference
+    int *varOf;      // per register: 1 + the local a bprel result refers to
+    int nregs;       // the number of registers varOf covers
+    IntVec *defs;    // per local: the blocks storing to it
+    IntVec *uses;    // per local: the blocks loading it before any store
+    int *entryLive;  // per local: whether it is live on entry to fn
+
+    // Blocks are indexed by their reverse postorder number.
+    IntVec *params;  // per block: the local of each parameter added
+    int *firstParam; // per block: the index of the first of them
+
+    int *cur;        // per local: the value stored last on the path
+    IntVec undo;     // pairs of a local and its previous value
+    int *subst;      // per register: the value that replaces it, or 0
+    int nsubst;
+    BitSet *bytes;   // registers known to hold a value in 0..255
+} Promoter;
+
+static int localIndex(Promoter *p, int r) {
+    return r < p->nregs ? p->varOf[r] - 1 : -1;
+}
+
+static Var *localOf(Promoter *p, int r) {
+    return p->varOf[r] ? p->vars[p->varOf[r] - 1] : NULL;
+}
+
+static void reject(Promoter *p, int r, int state) {
+    int v = p->varOf[r] - 1;
+    if (v >= 0 && p->state[v] == LOCAL_PROMOTED) p->state[v] = state;
+}
+
+// Finds the locals that can be promoted.
+static void findLocals(Promoter *p) {
+    Function *fn = p->fn;
+    for (int v = 0; v < p->nvars; v++) {
+        int size = p->vars[v]->ty->Size;
+        if (size != 1 && size != 4 && size != 8) p->state[v] = LOCAL_NOT_SCALAR;
+    }
+
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            if (ir->ty != IR_BPREL && ir->ty != IR_STORE_ARG) continue;
+            int v = LocalIndex(fn, ir->ID);
+            if (ir->ty == IR_BPREL) p->varOf[ir->r0] = v + 1;
+            if (!p->line[v]) p->line[v] = ir->Line;
+        }
+    }
+
+    IntVec uses = {0};
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            IRUses(fn, ir, &uses);
+            for (int i = 0; i < uses.len; i++) {
+                int r = IntVecGet(&uses, i);
+                Var *var = localOf(p, r);
+                if (!var) continue;
+
+                int access = (ir->ty == IR_LOAD && r == ir->r2) ||
+                             (ir->ty == IR_STORE && r == ir->r1 && r != ir->r2);
+                if (!access) reject(p, r, LOCAL_ESCAPES);
+                else if (ir->Size != var->ty->Size) reject(p, r, LOCAL_NOT_SCALAR);
+            }
+            if (ir->r0 && ir->ty != IR_BPREL) reject(p, ir->r0, LOCAL_ESCAPES);
+        }
+    }
+    IntVecFree(&uses);
+}
+
+// Returns the promoted local ir loads or stores, or -1.
+static int accessed(Promoter *p, IR *ir) {
+    int v = -1;
+    if (ir->ty == IR_LOAD) v = localIndex(p, ir->r2);
+    if (ir->ty == IR_STORE) v = localIndex(p, ir->r1);
+    if (ir->ty == IR_STORE_ARG) v = LocalIndex(p->fn, ir->ID);
+    return v >= 0 && p->state[v] == LOCAL_PROMOTED ? v : -1;
+}
+
+// Records, for each promoted local, the blocks that store to it and
+// those that load it before storing to it.
+static void scanAccesses(Promoter *p) {
+    Function *fn = p->fn;
+    int *stored = MemCalloc(MEM_OTHER, p->nvars, sizeof(int));
+    int *loaded = MemCalloc(MEM_OTHER, p->nvars, sizeof(int));
+
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        int stamp = i + 1;
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            int v = accessed(p, ir);
+            if (v < 0) continue;
+
+            if (ir->ty == IR_LOAD) {
+                if (stored[v] != stamp && loaded[v] != stamp) IntVecPush(&p->uses[v], bb->RPO);
+                loaded[v] = stamp;
+            } else {
+                if (stored[v] != stamp) IntVecPush(&p->defs[v], bb->RPO);
+                stored[v] = stamp;
+            }
+        }
+    }
+
+    MemFree(stored);
+    MemFree(loaded);
+}
+
+// Places the parameters of the promoted locals, on the iterated
+// dominance frontier of their stores where they are live.
+static void placeParams(Promoter *p) {
+    Function *fn = p->fn;
+    int n = fn->RPO.len;
+    int *live = MemCalloc(MEM_OTHER, n, sizeof(int));
+    int *def = MemCalloc(MEM_OTHER, n, sizeof(int));
+    int *queued = MemCalloc(MEM_OTHER, n, sizeof(int));
+    int *placed = MemCalloc(MEM_OTHER, n, sizeof(int));
+    int *work = MemMalloc(MEM_OTHER, sizeof(int) * n);
+
+    for (int i = 0; i < n; i++) {
+        p->firstParam[i] = BBVecGet(&fn->RPO, i)->Params.len;
+    }
+
+    for (int v = 0; v < p->nvars; v++) {
+        if (p->state[v] != LOCAL_PROMOTED) continue;
+        int stamp = v + 1;
+        for (int i = 0; i < p->defs[v].len; i++) def[IntVecGet(&p->defs[v], i)] = stamp;
+
+        // The local is live on entry to the blocks that load it first,
+        // and to the predecessors of live blocks that don't store it.
+        int top = 0;
+        for (int i = 0; i < p->uses[v].len; i++) {
+            int b = IntVecGet(&p->uses[v], i);
+            live[b] = stamp;
+            work[top++] = b;
+        }
+        while (top > 0) {
+            BB *bb = BBVecGet(&fn->RPO, work[--top]);
+            for (int i = 0; i < bb->Pred.len; i++) {
+                int b = BBVecGet(&bb->Pred, i)->RPO;
+                if (live[b] == stamp || def[b] == stamp) continue;
+                live[b] = stamp;
+                work[top++] = b;
+            }
+        }
+        p->entryLive[v] = live[0] == stamp;
+
+        for (int i = 0; i < p->defs[v].len; i++) {
+            int b = IntVecGet(&p->defs[v], i);
+            queued[b] = stamp;
+            work[top++] = b;
+        }
+        while (top > 0) {
+            BB *bb = BBVecGet(&fn->RPO, work[--top]);
+            for (int i = 0; i < bb->Frontier.len; i++) {
+                BB *df = BBVecGet(&bb->Frontier, i);
+                int b = df->RPO;
+                if (placed[b] == stamp || live[b] != stamp) continue;
+                placed[b] = stamp;
+
+                int r = AddReg(fn);
+                IntVecPush(&df->Params, r);
+                IntVecPush(&p->params[b], v);
+                if (p->vars[v]->ty->Size == 1) BitSetAdd(p->bytes, r);
+                if (queued[b] != stamp) {
+                    queued[b] = stamp;
+                    work[top++] = b;
+                }
+            }
+        }
+    }
+
+    MemFree(live);
+    MemFree(def);
+    MemFree(queued);
+    MemFree(placed);
+    MemFree(work);
+}
+
+static int lookup(Promoter *p, int r) {
+    return r < p->nsubst && p->subst[r] ? p->subst[r] : r;
+}
+
+static void setCur(Promoter *p, int v, int r) {
+    IntVecPush(&p->undo, v);
+    IntVecPush(&p->undo, p->cur[v]);
+    p->cur[v] = r;
+}
+
+// Finds the registers known to hold a value in 0..255, which can be
+// stored to a char without truncating them.
+static void scanBytes(Promoter *p) {
+    Function *fn = p->fn;
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            switch (ir->ty) {
+            case IR_IMM:
+                if (ir->imm < 0 || ir->imm > 255) break;
+            case IR_EQ:
+            case IR_NE:
+            case IR_LE:
+            case IR_LT:
+                BitSetAdd(p->bytes, ir->r0);
+                break;
+            case IR_LOAD:
+                if (ir->Size == 1) BitSetAdd(p->bytes, ir->r0);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+// Appends to args the values of the locals to pass to the parameters
+// added to bb.
+static void appendArgs(Promoter *p, BB *bb, IntVec *args) {
+    IntVec *params = &p->params[bb->RPO];
+    for (int i = 0; i < params->len; i++) {
+        int v = IntVecGet(params, i);
+        assert(p->cur[v]);
+        IntVecPush(args, p->cur[v]);
+    }
+}
+
+// Returns a block that jumps to bb, passing the locals its parameters
+// were added for, to stand for bb as the target of a branch.
+static BB *splitEdge(Promoter *p, BB *bb) {
+    Function *fn = p->fn;
+    BB *mid = MemCalloc(MEM_BB, 1, sizeof(BB));
+    mid->Label = nLabel++;
+    mid->RPO = -1;
+    BBVecPush(&fn->bbs, mid);
+
+    IR jmp = {.ty = IR_JMP, .bb1 = bb};
+    IntVec args = {0};
+    appendArgs(p, bb, &args);
+    SetBBArgs(fn, &jmp, IntVecData(&args), args.len);
+    IntVecFree(&args);
+    IRVecPush(&mid->IRs, jmp);
+    return mid;
+}
+
+// Renames the accesses to promoted locals in bb. Returns whether an
+// edge was split.
+static int renameBB(Promoter *p, BB *bb) {
+    Function *fn = p->fn;
+    IntVec *params = &p->params[bb->RPO];
+    for (int i = 0; i < params->len; i++) {
+        setCur(p, IntVecGet(params, i), IntVecGet(&bb->Params, p->firstParam[bb->RPO] + i));
+    }
+
+    IRCursor c;
+    IROpen(&c, bb);
+    if (bb->RPO == 0) {
+        // Locals live on entry are read before being written; they
+        // start out as 0, like the dummy definitions of liveness.
+        for (int v = 0; v < p->nvars; v++) {
+            if (p->state[v] != LOCAL_PROMOTED || !p->entryLive[v]) continue;
+            int r = AddReg(fn);
+            IRInsertBefore(&c, (IR){.ty = IR_IMM, .r0 = r, .imm = 0});
+            BitSetAdd(p->bytes, r);
+            setCur(p, v, r);
+        }
+    }
+
+    int split = 0;
+    for (IR *ir; (ir = IRCur(&c));) {
+        ir->r1 = lookup(p, ir->r1);
+        ir->r2 = lookup(p, ir->r2);
+        if (ir->ty == IR_CALL) {
+            for (int i = 0; i < ir->NArgs; i++) IRArgs(fn, ir)[i] = lookup(p, IRArgs(fn, ir)[i]);
+        }
+        if (ir->ty == IR_JMP) {
+            for (int i = 0; i < ir->NBBArgs; i++) IRBBArgs(fn, ir)[i] = lookup(p, IRBBArgs(fn, ir)[i]);
+        }
+
+        if (ir->ty == IR_BPREL && p->state[localIndex(p, ir->r0)] == LOCAL_PROMOTED) {
+            IRErase(&c);
+            continue;
+        }
+
+        int v = accessed(p, ir);
+        if (v >= 0 && ir->ty == IR_LOAD) {
+            assert(p->cur[v]);
+            p->subst[ir->r0] = p->cur[v];
+            IRErase(&c);
+            continue;
+        }
+        if (v >= 0 && ir->ty == IR_STORE_ARG) {
+            int r = AddReg(fn);
+            *ir = (IR){.ty = IR_LOAD_ARG, .r0 = r, .imm = ir->imm, .Size = ir->Size, .Line = ir->Line};
+            if (ir->Size == 1) BitSetAdd(p->bytes, r);
+            setCur(p, v, r);
+            IRNext(&c);
+            continue;
+        }
+        if (v >= 0) {
+            // A char keeps the low byte of what is stored to it.
+            int r = ir->r2;
+            IR store = *ir;
+            IRErase(&c);
+            if (store.Size == 1 && !BitSetContain(p->bytes, r)) {
+                int mask = AddReg(fn);
+                int masked = AddReg(fn);
+                IRInsertBefore(&c, (IR){.ty = IR_IMM, .r0 = mask, .imm = 255, .Line = store.Line});
+                IRInsertBefore(&c, (IR){.ty = IR_AND, .r0 = masked, .r1 = r, .r2 = mask, .Line = store.Line});
+                BitSetAdd(p->bytes, masked);
+                r = masked;
+            }
+            setCur(p, v, r);
+            continue;
+        }
+
+        if (ir->ty == IR_JMP && p->params[ir->bb1->RPO].len) {
+            IntVec args = {0};
+            for (int i = 0; i < ir->NBBArgs; i++) IntVecPush(&args, IRBBArgs(fn, ir)[i]);
+            appendArgs(p, ir->bb1, &args);
+            SetBBArgs(fn, ir, IntVecData(&args), args.len);
+            IntVecFree(&args);
+        }
+        if (ir->ty == IR_TEST) {
+            if (p->params[ir->bb1->RPO].len) {
+                ir->bb1 = splitEdge(p, ir->bb1);
+                split = 1;
+            }
+            if (p->params[ir->bb2->RPO].len) {
+                ir->bb2 = splitEdge(p, ir->bb2);
+                split = 1;
+            }
+        }
+        IRNext(&c);
+    }
+    IRClose(&c);
+    return split;
+}
+
+// Renames the accesses to promoted locals in dominator tree preorder,
+// restoring the current values of the locals when leaving a subtree.
+static int renameAll(Promoter *p) {
+    Function *fn = p->fn;
+    int n = fn->RPO.len;
+    BB **stack = MemMalloc(MEM_OTHER, sizeof(BB *) * n);
+    int *next = MemMalloc(MEM_OTHER, sizeof(int) * n);
+    int *undo = MemMalloc(MEM_OTHER, sizeof(int) * n);
+    int top = 0, split = 0;
+
+    BB *ent = BBVecGet(&fn->RPO, 0);
+    stack[top] = ent;
+    next[top] = 0;
+    undo[top++] = p->undo.len;
+    split |= renameBB(p, ent);
+
+    while (top > 0) {
+        BB *bb = stack[top - 1];
+        if (next[top - 1] < bb->DomChildren.len) {
+            BB *child = BBVecGet(&bb->DomChildren, next[top - 1]++);
+            stack[top] = child;
+            next[top] = 0;
+            undo[top++] = p->undo.len;
+            split |= renameBB(p, child);
+            continue;
+        }
+
+        top--;
+        while (p->undo.len > undo[top]) {
+            int old = IntVecPop(&p->undo);
+            p->cur[IntVecPop(&p->undo)] = old;
+        }
+    }
+
+    MemFree(stack);
+    MemFree(next);
+    MemFree(undo);
+    return split;
+}
+
+// Reports the locals promoted, and if final, those kept in memory.
+static void remarkLocals(Promoter *p, int final) {
+    for (int v = 0; v < p->nvars; v++) {
+        Var *var = p->vars[v];
+        char *name = *var->Name ? var->Name : "(temporary)";
+        int line = p->line[v];
+        if (!line || (p->state[v] != LOCAL_PROMOTED && !final)) {
+            continue;
+        } else if (p->state[v] == LOCAL_ESCAPES) {
+            Remark(REMARK_MISSED, "mem2reg", line, "local '%s' kept in memory: its address is taken", name);
+        } else if (p->state[v] == LOCAL_NOT_SCALAR) {
+            Remark(REMARK_MISSED, "mem2reg", line, "local '%s' kept in memory: it is not a scalar", name);
+        } else {
+            Remark(REMARK_PASS, "mem2reg", line, "promoted local '%s' to a register", name);
+        }
+    }
+}
+
+// Promotes the locals of fn that can be promoted. Returns how many
+// were.
+static int promote(Function *fn) {
+    Require(fn, ANALYSIS_FRONTIERS);
+    Promoter p = {0};
+    p.fn = fn;
+    p.nvars = VectorSize(fn->LocalVars);
+    p.vars = MemMalloc(MEM_OTHER, sizeof(Var *) * (p.nvars + 1));
+    for (int v = 0; v < p.nvars; v++) p.vars[v] = VectorGet(fn->LocalVars, v);
+    p.state = MemCalloc(MEM_OTHER, p.nvars + 1, sizeof(int));
+    p.line = MemCalloc(MEM_OTHER, p.nvars + 1, sizeof(int));
+    p.nregs = fn->NRegs + 1;
+    p.varOf = MemCalloc(MEM_OTHER, p.nregs, sizeof(int));
+    findLocals(&p);
+
+    int promoted = 0;
+    for (int v = 0; v < p.nvars; v++) promoted += p.state[v] == LOCAL_PROMOTED;
+    if (RemarksEnabled(REMARK_PASS, "mem2reg") || RemarksEnabled(REMARK_MISSED, "mem2reg"))
+        remarkLocals(&p, !promoted);
+
+    if (promoted) {
+        int nbbs = fn->RPO.len;
+        p.defs = MemCalloc(MEM_OTHER, p.nvars, sizeof(IntVec));
+        p.uses = MemCalloc(MEM_OTHER, p.nvars, sizeof(IntVec));
+        p.entryLive = MemCalloc(MEM_OTHER, p.nvars, sizeof(int));
+        p.params = MemCalloc(MEM_OTHER, nbbs, sizeof(IntVec));
+        p.firstParam = MemCalloc(MEM_OTHER, nbbs, sizeof(int));
+        p.cur = MemCalloc(MEM_OTHER, p.nvars, sizeof(int));
+        p.bytes = NewBitSet();
+        scanBytes(&p);
+        scanAccesses(&p);
+        placeParams(&p);
+
+        p.nsubst = fn->NRegs + 1;
+        p.subst = MemCalloc(MEM_OTHER, p.nsubst, sizeof(int));
+        if (renameAll(&p)) Invalidate(fn, ANALYSIS_CFG);
+
+        // Promoted locals need no stack slot.
+        int n = 0;
+        for (int v = 0; v < p.nvars; v++) {
+            if (p.state[v] == LOCAL_PROMOTED) p.vars[v]->Promoted = 1;
+            else VectorSet(fn->LocalVars, n++, p.vars[v]);
+        }
+        fn->LocalVars->len = n;
+
+        for (int v = 0; v < p.nvars; v++) {
+            IntVecFree(&p.defs[v]);
+            IntVecFree(&p.uses[v]);
+        }
+        for (int i = 0; i < nbbs; i++) IntVecFree(&p.params[i]);
+        IntVecFree(&p.undo);
+        BitSetFree(p.bytes);
+        MemFree(p.defs);
+        MemFree(p.uses);
+        MemFree(p.entryLive);
+        MemFree(p.params);
+        MemFree(p.firstParam);
+        MemFree(p.cur);
+        MemFree(p.subst);
+    } else {
+        for (int v = 0; v < p.nvars; v++) {
+            if (p.state[v] == LOCAL_ESCAPES) p.vars[v]->AddressTaken = 1;
+        }
+    }
+
+    MemFree(p.vars);
+    MemFree(p.state);
+    MemFree(p.line);
+    MemFree(p.varOf);
+    return promoted;
+}
+
+// Promotes the locals of fn whose address does not escape to SSA
+// registers. Promoting a pointer can leave the address of another
+// local used only by loads and stores, so this repeats until no more
+// locals can be promoted. Unreachable blocks, which the dominator tree
+// walk would not rename, are dropped first.
+int PromoteLocals(Function *fn) {
+    Require(fn, ANALYSIS_CFG);
+    int changed = RemoveUnreachable(fn);
+    while (promote(fn)) changed = 1;
+    return changed;
+}
@@ -0,0 +1,8 @@
+#ifndef MEM2REG_H
+#define MEM2REG_H
+
+#include "ir.h"
+
+int PromoteLocals(Function *fn);
+
+#endif
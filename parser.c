@@ -3,8 +3,11 @@
 #include <string.h>
 #include <stdarg.h>
 #include "util.h"
+#include "mem.h"
 #include "parser.h"
 #include "token.h"
+#include "stats.h"
+#include "timer.h"
 
 int nLabel = 1;
 
@@ -52,7 +55,7 @@ static Token *ExpectToken(Lexer *lexer, TokenType type) {
 }
 
 Env *newEnv(Env *prev) {
-    Env *env = calloc(1, sizeof(Env));
+    Env *env = MemCalloc(MEM_AST, 1, sizeof(Env));
     env->vars = NewMap();
     env->typedefs = NewMap();
     env->tags = NewMap();
@@ -61,7 +64,7 @@ Env *newEnv(Env *prev) {
 }
 
 Parser *NewParser(Lexer *lexer) {
-    Parser *parser = calloc(1, sizeof(Parser));
+    Parser *parser = MemCalloc(MEM_OTHER, 1, sizeof(Parser));
     parser->env = newEnv(NULL);
     parser->lexer = lexer;
 }
@@ -132,15 +135,26 @@ Expression *NewStringExp(Parser *parser, char *s) {
     return exp;
 }
 
-Expression *scalePtr(Expression *exp, Type *ty) {
+// Returns exp times (op TOKEN_OP_MUL) or divided by (TOKEN_OP_DIV) the
+// size of ty, for pointer arithmetic on pointers to ty.
+Expression *scaleBy(Expression *exp, Type *ty, TokenType op) {
     if (ty->Size == 1) {
         return exp;
     }
-    Token *token = calloc(1, sizeof(Token));
+    if (op == TOKEN_OP_MUL && IsNumExp(exp)) {
+        return NewIntExp(exp->Val * ty->Size, exp->Op);
+    }
+    Token *token = MemCalloc(MEM_TOKEN, 1, sizeof(Token));
     token->Line = exp->Op->Line;
     token->Literal = exp->Op->Literal;
-    token->Type = TOKEN_OP_MUL;
-    return NewBinop(token, exp, NewIntExp(ty->Size, token));
+    token->Type = op;
+    Expression *ret = NewBinop(token, exp, NewIntExp(ty->Size, token));
+    ret->ctype = &IntType;
+    return ret;
+}
+
+Expression *scalePtr(Expression *exp, Type *ty) {
+    return scaleBy(exp, ty, TOKEN_OP_MUL);
 }
 
 Expression *parseLocalVar(Parser *parser, Token *token) {
@@ -259,9 +273,32 @@ Expression *parsePrimary(Parser *parser) {
 }
 
 // `x++` where x is of type T is compiled as
-// `({ T *y = &x; T z = *y; *y = *y + 1; z; })`.
+// `({ T *y = &x; T z = *y; *y = *y + 1; z; })`, or as
+// `({ T z = x; x = x + 1; z; })` if x is a variable, so that its
+// address is not taken.
 Expression *NewPostIncrease(Parser *parser, Token *token, Expression *exp, int imm) {
     Vector *v = NewVector();
+    if (exp->ctype->ty == PTR) imm *= exp->ctype->Ptr->Size;
+    token->Type = TOKEN_OP_ADD;
+
+    if (exp->ty == EXP_VARREF) {
+        Var *var = addLocalVar(parser, exp->ctype, "");
+
+        Expression *exp1 = NewExp(EXP_ASSIGN, token);
+        exp1->Exp1 = NewVarref(token, var);
+        exp1->Exp2 = exp;
+        exp1->ctype = exp1->Exp1->ctype;
+
+        Expression *exp2 = NewExp(EXP_ASSIGN, token);
+        exp2->Exp1 = NewVarref(token, exp->ID);
+        exp2->Exp2 = NewBinop(token, NewVarref(token, exp->ID), NewIntExp(imm, token));
+        exp2->ctype = exp2->Exp1->ctype;
+
+        VectorPush(v, exp1);
+        VectorPush(v, exp2);
+        VectorPush(v, NewVarref(token, var));
+        return NewStmtExp(token, v);
+    }
 
     Var *var1 = addLocalVar(parser, PtrTo(exp->ctype), "");
     Var *var2 = addLocalVar(parser, exp->ctype, "");
@@ -278,7 +315,6 @@ Expression *NewPostIncrease(Parser *parser, Token *token, Expression *exp, int i
 
     Expression *exp3 = NewExp(EXP_ASSIGN, token);
     exp3->Exp1 = NewDerefVar(token, var1);
-    token->Type = TOKEN_OP_ADD;
     exp3->Exp2 = NewBinop(token, NewDerefVar(token, var1), NewIntExp(imm, token));
     exp3->ctype = exp3->Exp1->ctype;
 
@@ -372,6 +408,7 @@ Expression *parseUnary(Parser *parser) {
             switch (token->Type) {
             case TOKEN_OP_NOT:
                 exp->Val = exp->Val == 0;
+                break;
             case TOKEN_OP_BNOT:
                 exp->Val = ~exp->Val;
             }
@@ -513,7 +550,7 @@ Expression *parseAddSub(Parser *parser) {
             }
 
             if (exp->Exp1->ctype->ty == PTR) {
-                exp->Exp2 = scalePtr(exp->Exp2, exp->Exp1->ctype);
+                exp->Exp2 = scalePtr(exp->Exp2, exp->Exp1->ctype->Ptr);
                 exp->ctype = exp->Exp1->ctype;
             } else {
                 exp->ctype = &IntType;
@@ -527,9 +564,16 @@ Expression *parseAddSub(Parser *parser) {
                 if (!IsSameType(exp->Exp1->ctype, exp->Exp2->ctype)) {
                     Error(parser->lexer, token, "incompatible pointer.");
                 } else {
-                    exp = scalePtr(exp, exp->Exp1->ctype);
-                    exp->ctype = exp->Exp1->ctype;
+                    exp->ctype = &IntType;
+                    exp = scaleBy(exp, exp->Exp1->ctype->Ptr, TOKEN_OP_DIV);
                 }
+            } else if (exp->Exp1->ctype->ty == PTR) {
+                if (!IsNumType(exp->Exp2->ctype)) {
+                    ErrorAt(parser->lexer, token->Original,
+                          "the right side of the operator is not a number.");
+                }
+                exp->Exp2 = scalePtr(exp->Exp2, exp->Exp1->ctype->Ptr);
+                exp->ctype = exp->Exp1->ctype;
             } else {
                 exp->ctype = &IntType;
             }
@@ -858,8 +902,22 @@ Expression *parseConditional(Parser *parser) {
 }
 
 // `x op= y` where x is of type T is compiled as
-// `({ T *z = &x; *z = *z op y; })`.
+// `({ T *z = &x; *z = *z op y; })`, or as `x = x op y` if x is a
+// variable, so that its address is not taken.
 Expression *NewAssignEqual(Parser *parser, Token *op, Expression *exp1, Expression *exp2) {
+    op->Type = ChangeOpEqual(op->Type);
+    if (exp1->ctype->ty == PTR && (op->Type == TOKEN_OP_ADD || op->Type == TOKEN_OP_SUB)) {
+        exp2 = scalePtr(exp2, exp1->ctype->Ptr);
+    }
+
+    if (exp1->ty == EXP_VARREF) {
+        Expression *exp = NewExp(EXP_ASSIGN, op);
+        exp->Exp1 = exp1;
+        exp->Exp2 = NewBinop(op, NewVarref(op, exp1->ID), exp2);
+        exp->ctype = exp1->ctype;
+        return exp;
+    }
+
     Vector *v = NewVector();
     Var *var = addLocalVar(parser, PtrTo(exp1->ctype), "");
 
@@ -872,7 +930,6 @@ Expression *NewAssignEqual(Parser *parser, Token *op, Expression *exp1, Expressi
     // *z = *z op y
     Expression *tmp2 = NewExp(EXP_ASSIGN, op);
     tmp2->Exp1 = NewDerefVar(op, var);
-    op->Type = ChangeOpEqual(op->Type);
     tmp2->Exp2 = NewBinop(op, NewDerefVar(op, var), exp2);
     tmp2->ctype = tmp2->Exp1->ctype;
 
@@ -945,32 +1002,33 @@ int parseConstExp(Parser *parser) {
 }
 
 Type *parseArray(Parser *parser, Type *ty) {
-    Vector *v = NewVector();
+    IntVec v = {0};
 
     while (ConsumeToken(parser->lexer, TOKEN_SEP_LBRACK)) {
         if (ConsumeToken(parser->lexer, TOKEN_SEP_RBRACK)) {
-            VectorPushInt(v, -1);
+            IntVecPush(&v, -1);
             continue;
         }
-        VectorPushInt(v, parseConstExp(parser));
+        IntVecPush(&v, parseConstExp(parser));
         ExpectToken(parser->lexer, TOKEN_SEP_RBRACK);
     }
 
-    for (int i = VectorSize(v) - 1; i >= 0; i--) {
-        int len = VectorGetInt(v, i);
+    for (int i = v.len - 1; i >= 0; i--) {
+        int len = IntVecGet(&v, i);
         ty = ArrayOf(ty, len);
     }
+    IntVecFree(&v);
     return ty;
 }
 
 Declaration *DirectDeclaration(Parser *parser, Type *ty) {
     Token *token = PeekToken(parser->lexer);
     Declaration *decl;
-    Type *placeholder = calloc(1, sizeof(Type));
+    Type *placeholder = MemCalloc(MEM_TYPE, 1, sizeof(Type));
 
     switch (token->Type) {
     case TOKEN_IDENTIFIER:
-        decl = calloc(1, sizeof(Declaration));
+        decl = MemCalloc(MEM_AST, 1, sizeof(Declaration));
         decl->token = token;
         decl->ty = placeholder;
         decl->Name = token->Literal;
@@ -1327,13 +1385,13 @@ void parseTopLevel(Parser *parser) {
                 switch (init->ctype->ty) {
                 case CHAR: {
                     rawdatasize = 1;
-                    char *p = malloc(rawdatasize);
+                    char *p = MemMalloc(MEM_OTHER, rawdatasize);
                     *p = (char)init->Val;
                     rawdata = p;
                 }
                 case INT: {
                     rawdatasize = 4;
-                    int *p = malloc(rawdatasize);
+                    int *p = MemMalloc(MEM_OTHER, rawdatasize);
                     *p = (int)init->Val;
                     rawdata = p;
                 }
@@ -1357,7 +1415,8 @@ void parseTopLevel(Parser *parser) {
         ExpectToken(parser->lexer, TOKEN_SEP_SEMI);
     } else { // Function
         // define func type
-        Type *func = calloc(1, sizeof(Type));
+        int nodes = ASTNodeCount;
+        Type *func = MemCalloc(MEM_TYPE, 1, sizeof(Type));
         func->ty = FUNC;
         func->Returning = ty;
 
@@ -1385,11 +1444,17 @@ void parseTopLevel(Parser *parser) {
         Function *fn = NewFunction();
         fn->Stmt = parseCompoundStmt(parser);
         fn->Name = decl->Name;
+        fn->Line = decl->token->Line;
         fn->Params = params;
         fn->LocalVars = parser->LocalVars;
-        fn->bbs = NewVector();
         VectorPush(parser->program->Functions, fn);
 
+        if (StatsEnabled) {
+            Stats *st = GetStats(fn);
+            st->Lines = parser->lexer->line - fn->Line + 1;
+            st->ASTNodes = ASTNodeCount - nodes;
+        }
+
         parser->env = parser->env->prev;
         return;
     }
@@ -1397,9 +1462,14 @@ void parseTopLevel(Parser *parser) {
 
 Program *ParseProgram(Parser *parser) {
     parser->program = NewProgram();
+    parser->program->File = parser->lexer->chunkName;
 
+    Vector *fns = parser->program->Functions;
     while (PeekToken(parser->lexer)->Type != TOKEN_EOF) {
+        int n = VectorSize(fns);
+        TimerBegin(PHASE_PARSE);
         parseTopLevel(parser);
+        TimerEnd(VectorSize(fns) > n ? ((Function *)VectorLast(fns))->Name : NULL);
     }
     parser->program->macros = parser->lexer->macros;
     return parser->program;
@@ -0,0 +1,112 @@
+// Pass manager.
+//
+// A pipeline is a list of passes run on each function in order.
+// Passes that work on virtual registers run between GenProgram and
+// Analyze; passes marked PostRA run after Allocate.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pass.h"
+#include "analyzer.h"
+#include "cfg.h"
+#include "generator.h"
+#include "mem2reg.h"
+#include "sccp.h"
+#include "instcombine.h"
+#include "gvn.h"
+#include "licm.h"
+#include "dce.h"
+#include "simplifycfg.h"
+#include "loadelim.h"
+#include "dse.h"
+#include "allocator.h"
+#include "stats.h"
+#include "timer.h"
+
+static Pass passes[] = {
+    {"mem2reg", PromoteLocals, ANALYSIS_ALL & ~ANALYSIS_LIVENESS, 0},
+    {"sccp", PropagateConstants, ANALYSIS_ALL & ~ANALYSIS_LIVENESS, 0},
+    {"instcombine", CombineInstructions, ANALYSIS_ALL & ~ANALYSIS_LIVENESS, 0},
+    {"gvn", NumberValues, ANALYSIS_ALL & ~ANALYSIS_LIVENESS, 0},
+    {"licm", HoistInvariants, ANALYSIS_ALL & ~ANALYSIS_LIVENESS, 0},
+    {"loadelim", EliminateLoads, ANALYSIS_ALL & ~ANALYSIS_LIVENESS, 0},
+    {"dse", EliminateDeadStores, ANALYSIS_ALL & ~ANALYSIS_LIVENESS, 0},
+    {"dce", EliminateDeadCode, ANALYSIS_ALL & ~ANALYSIS_LIVENESS, 0},
+    {"simplifycfg", SimplifyCFG, ANALYSIS_ALL & ~ANALYSIS_LIVENESS, 0},
+    {"peephole", Peephole, ANALYSIS_ALL, 1},
+};
+
+// Pipelines for -O0, -O1 and -O2. -O1 only promotes locals and folds
+// what that exposes; -O2 also moves, merges and removes loads, stores
+// and recomputed values.
+static char *levels[] = {
+    "",
+    "mem2reg,sccp,simplifycfg,instcombine,dce,peephole",
+    "mem2reg,sccp,simplifycfg,instcombine,licm,gvn,loadelim,dse,instcombine,dce,simplifycfg,peephole",
+};
+
+void Require(Function *fn, int analyses) {
+    // Frontiers and loops are found from the dominator tree; it and
+    // liveness are computed over the CFG.
+    if (analyses & (ANALYSIS_FRONTIERS | ANALYSIS_LOOPS)) analyses |= ANALYSIS_DOMINATORS;
+    if (analyses & (ANALYSIS_DOMINATORS | ANALYSIS_LIVENESS)) analyses |= ANALYSIS_CFG;
+    int missing = analyses & ~fn->Analyses;
+
+    if (missing & ANALYSIS_CFG) ComputeCFG(fn);
+    if (missing & ANALYSIS_DOMINATORS) ComputeDominators(fn);
+    if (missing & ANALYSIS_FRONTIERS) ComputeFrontiers(fn);
+    if (missing & ANALYSIS_LOOPS) ComputeLoops(fn);
+    if (missing & ANALYSIS_LIVENESS) ComputeLiveness(fn);
+    fn->Analyses |= missing;
+}
+
+void Invalidate(Function *fn, int analyses) {
+    // Everything else is derived from the CFG, and frontiers and
+    // loops from the dominator tree.
+    if (analyses & ANALYSIS_CFG) analyses = ANALYSIS_ALL;
+    if (analyses & ANALYSIS_DOMINATORS) analyses |= ANALYSIS_FRONTIERS | ANALYSIS_LOOPS;
+    fn->Analyses &= ~analyses;
+}
+
+Vector *ParsePipeline(char *s) {
+    Vector *v = NewVector();
+    while (*s) {
+        int len = strcspn(s, ",");
+        Pass *pass = NULL;
+        for (int i = 0; i < sizeof(passes) / sizeof(*passes); i++) {
+            if (strlen(passes[i].Name) == len && !strncmp(passes[i].Name, s, len)) {
+                pass = &passes[i];
+            }
+        }
+        if (!pass) {
+            fprintf(stderr, "Unknown pass '%.*s'\n", len, s);
+            exit(1);
+        }
+        VectorPush(v, pass);
+
+        s += len;
+        if (*s == ',') s++;
+    }
+    return v;
+}
+
+Vector *PipelineForLevel(int level) {
+    int n = sizeof(levels) / sizeof(*levels);
+    return ParsePipeline(levels[level < n ? level : n - 1]);
+}
+
+void RunPasses(Program *prog, Vector *pipeline, int postRA) {
+    for (int i = 0; i < VectorSize(prog->Functions); i++) {
+        Function *fn = VectorGet(prog->Functions, i);
+        TimerBegin(PHASE_OPT);
+        for (int i = 0; i < VectorSize(pipeline); i++) {
+            Pass *pass = VectorGet(pipeline, i);
+            if (pass->PostRA != postRA)
+                continue;
+            if (pass->Run(fn))
+                Invalidate(fn, ~pass->Preserves);
+            StatsStageEnd(fn, pass->Name);
+        }
+        TimerEnd(fn->Name);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef PASS_H
+#define PASS_H
+
+#include "ir.h"
+
+// Per-function analyses. Function.Analyses holds the set of analyses
+// whose results are up to date; passes ask for the ones they need
+// with Require, which only recomputes those that were invalidated.
+enum {
+    ANALYSIS_CFG = 1,        // BB.Succ, BB.Pred, BB.RPO, Function.RPO
+    ANALYSIS_DOMINATORS = 2, // BB.IDom, BB.DomChildren
+    ANALYSIS_LIVENESS = 4,   // BB.DefRegs, BB.InRegs, BB.OutRegs
+    ANALYSIS_FRONTIERS = 8,  // BB.Frontier
+    ANALYSIS_LOOPS = 16,     // BB.Loop, Function.Loops
+};
+
+#define ANALYSIS_ALL (ANALYSIS_CFG | ANALYSIS_DOMINATORS | ANALYSIS_LIVENESS | \
+                      ANALYSIS_FRONTIERS | ANALYSIS_LOOPS)
+
+typedef struct Pass {
+    char *Name;
+
+    // Runs the pass on a function and returns nonzero if it changed
+    // the IR.
+    int (*Run)(Function *fn);
+
+    // Analyses that stay valid when the pass changes the IR.
+    int Preserves;
+
+    // Whether the pass runs on register-allocated IR.
+    int PostRA;
+} Pass;
+
+void Require(Function *fn, int analyses);
+void Invalidate(Function *fn, int analyses);
+
+Vector *ParsePipeline(char *s);
+Vector *PipelineForLevel(int level);
+void RunPasses(Program *prog, Vector *pipeline, int postRA);
+
+#endif
@@ -0,0 +1,48 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "remark.h"
+#include "util.h"
+
+static char *flags[] = {"-Rpass", "-Rpass-missed"};
+
+char *RemarkFile;
+
+// Whether remarks of each kind are wanted from every pass, and the
+// passes they are wanted from otherwise.
+static int all[2];
+static Vector *passes[2];
+
+// Enables remarks of the given kind from pass, or from every pass if
+// pass is NULL.
+void EnableRemarks(RemarkKind kind, char *pass) {
+    if (!pass) {
+        all[kind] = 1;
+        return;
+    }
+    if (!passes[kind]) passes[kind] = NewVector();
+    VectorPush(passes[kind], pass);
+}
+
+int RemarksEnabled(RemarkKind kind, char *pass) {
+    if (all[kind]) return 1;
+    for (int i = 0; passes[kind] && i < VectorSize(passes[kind]); i++) {
+        if (!strcmp(VectorGet(passes[kind], i), pass)) return 1;
+    }
+    return 0;
+}
+
+void Remark(RemarkKind kind, char *pass, int line, char *fmt, ...) {
+    if (!RemarksEnabled(kind, pass)) return;
+
+    va_list ap;
+    va_start(ap, fmt);
+    if (line > 0) {
+        fprintf(stderr, "%s:%d: remark: ", RemarkFile, line);
+    } else {
+        fprintf(stderr, "%s: remark: ", RemarkFile);
+    }
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, " [%s=%s]\n", flags[kind], pass);
+    va_end(ap);
+}
@@ -0,0 +1,23 @@
+#ifndef REMARK_H
+#define REMARK_H
+
+// Optimization remarks for -Rpass and -Rpass-missed.
+//
+// A remark says what a pass did (REMARK_PASS) or could not do
+// (REMARK_MISSED) at some source line. Remarks are printed to stderr
+// as they are made, in the format of compiler diagnostics.
+
+typedef enum RemarkKind {
+    REMARK_PASS,
+    REMARK_MISSED,
+} RemarkKind;
+
+// The source file the remarks refer to.
+extern char *RemarkFile;
+
+void EnableRemarks(RemarkKind kind, char *pass);
+int RemarksEnabled(RemarkKind kind, char *pass);
+__attribute__((format(printf, 4, 5)))
+void Remark(RemarkKind kind, char *pass, int line, char *fmt, ...);
+
+#endif
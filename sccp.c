@@ -0,0 +1,241 @@
+// Sparse conditional constant propagation.
+//
+// The algorithm of Wegman and Zadeck: every register starts out
+// unknown and only the entry block executable. Instructions of
+// executable blocks are evaluated over the lattice
+//
+//   unknown > constant > varying
+//
+// and registers are only ever lowered, so each is revisited a bounded
+// number of times. A branch on a constant makes only one edge
+// executable, and block parameters meet the arguments of the
+// executable jumps to their block only, so constants flow around
+// loops and through branches that never run. Afterwards constant
+// registers become immediates, constant branches jumps, and blocks
+// that never ran are removed.
+#include "sccp.h"
+#include "cfg.h"
+#include "mem.h"
+#include "pass.h"
+#include "remark.h"
+#include <limits.h>
+
+enum {
+    VAL_UNKNOWN,
+    VAL_CONST,
+    VAL_VARYING,
+};
+
+typedef struct Value {
+    int state;
+    long long c;
+} Value;
+
+typedef struct SCCP {
+    Function *fn;
+    DefUse *du;
+    Value *vals;      // per register
+    char *executable; // per block, by reverse postorder number
+    IntVec blockWork;
+    IntVec siteWork;
+} SCCP;
+
+// Lowers the value of r to its meet with v, and queues its users if
+// that changed it.
+static void lower(SCCP *s, int r, Value v) {
+    Value *old = &s->vals[r];
+    if (old->state == VAL_VARYING || v.state == VAL_UNKNOWN) return;
+    if (old->state == VAL_CONST && v.state == VAL_CONST && old->c == v.c) return;
+
+    if (old->state == VAL_UNKNOWN) *old = v;
+    else old->state = VAL_VARYING;
+
+    IntVec *users = &s->du->Users[r];
+    for (int i = 0; i < users->len; i++) IntVecPush(&s->siteWork, IntVecGet(users, i));
+}
+
+static void markExecutable(SCCP *s, BB *bb) {
+    if (s->executable[bb->RPO]) return;
+    s->executable[bb->RPO] = 1;
+    IntVecPush(&s->blockWork, bb->RPO);
+}
+
+static Value evaluate(SCCP *s, IR *ir) {
+    Value varying = {VAL_VARYING};
+    switch (ir->ty) {
+    case IR_IMM:
+        return (Value){VAL_CONST, ir->imm};
+    case IR_MOV:
+        return s->vals[ir->r2];
+    case IR_NEG: {
+        Value a = s->vals[ir->r1];
+        if (a.state == VAL_CONST) FoldIR(IR_NEG, a.c, 0, &a.c);
+        return a;
+    }
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_MOD:
+    case IR_AND:
+    case IR_OR:
+    case IR_XOR:
+    case IR_SHL:
+    case IR_SHR:
+    case IR_EQ:
+    case IR_NE:
+    case IR_LE:
+    case IR_LT: {
+        Value a = s->vals[ir->r1], b = s->vals[ir->r2];
+        if (a.state == VAL_VARYING || b.state == VAL_VARYING) return varying;
+        if (a.state == VAL_UNKNOWN || b.state == VAL_UNKNOWN) return (Value){VAL_UNKNOWN};
+        Value v = {VAL_CONST};
+        return FoldIR(ir->ty, a.c, b.c, &v.c) ? v : varying;
+    }
+    default:
+        return varying;
+    }
+}
+
+static void visit(SCCP *s, IR *ir) {
+    if (ir->ty == IR_JMP) {
+        BB *to = ir->bb1;
+        markExecutable(s, to);
+        for (int i = 0; i < ir->NBBArgs; i++) {
+            lower(s, IntVecGet(&to->Params, i), s->vals[IRBBArgs(s->fn, ir)[i]]);
+        }
+        return;
+    }
+
+    if (ir->ty == IR_TEST) {
+        Value cond = s->vals[ir->r2];
+        if (cond.state == VAL_UNKNOWN) return;
+        if (cond.state == VAL_VARYING || cond.c) markExecutable(s, ir->bb1);
+        if (cond.state == VAL_VARYING || !cond.c) markExecutable(s, ir->bb2);
+        return;
+    }
+
+    if (ir->r0) lower(s, ir->r0, evaluate(s, ir));
+}
+
+static void solve(SCCP *s) {
+    Function *fn = s->fn;
+    markExecutable(s, BBVecGet(&fn->RPO, 0));
+    while (s->blockWork.len || s->siteWork.len) {
+        if (s->blockWork.len) {
+            BB *bb = BBVecGet(&fn->RPO, IntVecPop(&s->blockWork));
+            for (int i = 0; i < bb->IRs.len; i++) visit(s, IRVecData(&bb->IRs) + i);
+            continue;
+        }
+
+        IRSite *site = &s->du->Sites[IntVecPop(&s->siteWork)];
+        if (site->bb->RPO >= 0 && s->executable[site->bb->RPO]) visit(s, SiteIR(site));
+    }
+}
+
+static int isImm(Value v) {
+    return v.state == VAL_CONST && v.c >= INT_MIN && v.c <= INT_MAX;
+}
+
+// Replaces the parameters of bb that are constant by immediates and
+// drops the arguments passed to them.
+static int foldParams(SCCP *s, BB *bb) {
+    Function *fn = s->fn;
+    IntVec *params = &bb->Params;
+    char *drop = MemCalloc(MEM_OTHER, params->len + 1, 1);
+    int n = 0, folded = 0;
+    IR *first = IRVecData(&bb->IRs);
+    int line = first->Line;
+
+    IRCursor c;
+    IROpen(&c, bb);
+    for (int i = 0; i < params->len; i++) {
+        int r = IntVecGet(params, i);
+        if (isImm(s->vals[r])) {
+            IRInsertBefore(&c, (IR){.ty = IR_IMM, .r0 = r, .imm = s->vals[r].c, .Line = line});
+            drop[i] = folded = 1;
+        } else {
+            IntVecSet(params, n++, r);
+        }
+    }
+    IRClose(&c);
+
+    if (folded) {
+        IntVec args = {0};
+        for (int i = 0; i < fn->bbs.len; i++) {
+            BB *pred = BBVecGet(&fn->bbs, i);
+            IR *ir = IRVecData(&pred->IRs) + pred->IRs.len - 1;
+            if (ir->ty != IR_JMP || ir->bb1 != bb) continue;
+            args.len = 0;
+            for (int i = 0; i < ir->NBBArgs; i++) {
+                if (!drop[i]) IntVecPush(&args, IRBBArgs(fn, ir)[i]);
+            }
+            SetBBArgs(fn, ir, IntVecData(&args), args.len);
+        }
+        IntVecFree(&args);
+    }
+    params->len = n;
+    MemFree(drop);
+    return folded;
+}
+
+// Rewrites the executable blocks with what was found. Returns 1 if
+// some instruction changed and 2 if some branch did.
+static int rewrite(SCCP *s) {
+    Function *fn = s->fn;
+    int changed = 0;
+    for (int i = 0; i < fn->RPO.len; i++) {
+        BB *bb = BBVecGet(&fn->RPO, i);
+        if (!s->executable[i]) continue;
+        changed |= foldParams(s, bb);
+
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            if (ir->ty == IR_TEST && s->vals[ir->r2].state == VAL_CONST) {
+                int taken = s->vals[ir->r2].c != 0;
+                Remark(REMARK_PASS, "sccp", ir->Line, "folded branch: its condition is always %s",
+                       taken ? "true" : "false");
+                *ir = (IR){.ty = IR_JMP, .bb1 = taken ? ir->bb1 : ir->bb2, .Line = ir->Line};
+                changed = 2;
+                continue;
+            }
+            if (!ir->r0 || ir->ty == IR_IMM || !isImm(s->vals[ir->r0])) continue;
+            *ir = (IR){.ty = IR_IMM, .r0 = ir->r0, .imm = s->vals[ir->r0].c, .Line = ir->Line};
+            changed |= 1;
+        }
+    }
+    return changed;
+}
+
+// Propagates constants in fn and folds the branches on them.
+int PropagateConstants(Function *fn) {
+    Require(fn, ANALYSIS_CFG);
+    SCCP s = {0};
+    s.fn = fn;
+    s.du = NewDefUse(fn);
+    s.vals = MemCalloc(MEM_OTHER, fn->NRegs + 1, sizeof(Value));
+    s.executable = MemCalloc(MEM_OTHER, fn->RPO.len, 1);
+
+    // A register not in SSA form varies.
+    for (int i = 0; i <= fn->NRegs; i++) {
+        if (s.du->Def[i] == DEF_MANY) s.vals[i].state = VAL_VARYING;
+    }
+
+    solve(&s);
+    FreeDefUse(s.du);
+    int changed = rewrite(&s);
+
+    // Blocks that never run are unreachable now that the branches to
+    // them are gone.
+    if (changed & 2) {
+        Invalidate(fn, ANALYSIS_CFG);
+        Require(fn, ANALYSIS_CFG);
+        RemoveUnreachable(fn);
+    }
+
+    IntVecFree(&s.blockWork);
+    IntVecFree(&s.siteWork);
+    MemFree(s.vals);
+    MemFree(s.executable);
+    return changed != 0;
+}
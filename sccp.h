@@ -0,0 +1,8 @@
+#ifndef SCCP_H
+#define SCCP_H
+
+#include "ir.h"
+
+int PropagateConstants(Function *fn);
+
+#endif
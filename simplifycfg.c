@@ -0,0 +1,187 @@
+// Control flow graph simplification.
+//
+// Repeats, until the CFG stops changing:
+//
+// - A branch to the same block twice becomes a jump.
+// - Edges to a forwarding block, one without parameters or
+//   instructions other than a jump, go to its target instead.
+// - A jump passing a constant to a block that only branches on that
+//   parameter goes to the block the branch would take; the && and ||
+//   operators produce such blocks.
+// - A block with a single predecessor that jumps to it is merged into
+//   the predecessor, its parameters replaced by the arguments.
+//
+// and removes the blocks left unreachable.
+#include "simplifycfg.h"
+#include "cfg.h"
+#include "mem.h"
+#include "pass.h"
+
+static IR *terminator(BB *bb) {
+    return IRVecData(&bb->IRs) + bb->IRs.len - 1;
+}
+
+static int isForwarding(BB *bb) {
+    return bb->IRs.len == 1 && !bb->Params.len && terminator(bb)->ty == IR_JMP;
+}
+
+// Returns the last forwarding block on the chain starting at bb, or
+// NULL if bb is not forwarding or the chain loops.
+static BB *lastForwarding(Function *fn, BB *bb) {
+    if (!isForwarding(bb)) return NULL;
+    for (int n = 0; n < fn->bbs.len; n++) {
+        BB *to = terminator(bb)->bb1;
+        if (!isForwarding(to)) return bb;
+        bb = to;
+    }
+    return NULL;
+}
+
+// Returns the block a branch to bb reaches if bb is forwarding without
+// passing arguments, or bb.
+static BB *branchTarget(Function *fn, BB *bb) {
+    BB *last = lastForwarding(fn, bb);
+    return last && !terminator(last)->NBBArgs ? terminator(last)->bb1 : bb;
+}
+
+// Returns the block a jump passing args to bb goes to right away if
+// bb only branches on its single parameter, which nothing else reads,
+// and gets a constant for it, or NULL. Branch targets have no
+// parameters, so a jump past bb can't pass on values bb gets for the
+// blocks it dominates.
+static BB *threadTarget(DefUse *du, BB *bb, int *args) {
+    if (bb->IRs.len != 1 || terminator(bb)->ty != IR_TEST) return NULL;
+    IR *test = terminator(bb);
+    if (bb->Params.len != 1 || IntVecGet(&bb->Params, 0) != test->r2) return NULL;
+    if (du->Def[test->r2] == DEF_MANY || du->Users[test->r2].len != 1) return NULL;
+    int k = du->Def[args[0]];
+    if (k < 0 || SiteIR(&du->Sites[k])->ty != IR_IMM) return NULL;
+    return SiteIR(&du->Sites[k])->imm ? test->bb1 : test->bb2;
+}
+
+// Makes the jump ir go past forwarding blocks and the branches it
+// decides. Returns whether it changed.
+static int redirectJmp(Function *fn, DefUse *du, IR *ir) {
+    BB *to = ir->bb1;
+    int *args = IRBBArgs(fn, ir);
+    int nargs = ir->NBBArgs;
+    int steps = 0;
+    for (;;) {
+        BB *next;
+        if (isForwarding(to)) {
+            IR *jmp = terminator(to);
+            next = jmp->bb1;
+            args = IRBBArgs(fn, jmp);
+            nargs = jmp->NBBArgs;
+        } else if ((next = threadTarget(du, to, args))) {
+            nargs = 0; // branch targets have no parameters
+        } else {
+            break;
+        }
+        to = next;
+        // The jump can't get anywhere if it goes around in circles.
+        if (++steps > fn->bbs.len) return 0;
+    }
+    if (!steps) return 0;
+
+    IntVec v = {0};
+    for (int i = 0; i < nargs; i++) IntVecPush(&v, args[i]);
+    ir->bb1 = to;
+    SetBBArgs(fn, ir, IntVecData(&v), v.len);
+    IntVecFree(&v);
+    return 1;
+}
+
+// Redirects the terminator of bb. Returns whether it changed.
+static int redirect(Function *fn, DefUse *du, BB *bb) {
+    IR *ir = terminator(bb);
+    if (ir->ty == IR_JMP) return redirectJmp(fn, du, ir);
+    if (ir->ty != IR_TEST) return 0;
+
+    BB *bb1 = branchTarget(fn, ir->bb1);
+    BB *bb2 = branchTarget(fn, ir->bb2);
+    int changed = bb1 != ir->bb1 || bb2 != ir->bb2;
+    ir->bb1 = bb1;
+    ir->bb2 = bb2;
+    if (bb1 == bb2) {
+        *ir = (IR){.ty = IR_JMP, .bb1 = bb1, .Line = ir->Line};
+        changed = 1;
+    }
+    return changed;
+}
+
+// Merges the successor of bb into it while that has no other
+// predecessor. The parameters of merged blocks get their argument
+// registers in subst. Returns whether any was merged.
+static int merge(Function *fn, BB *bb, int *subst) {
+    int merged = 0;
+    for (;;) {
+        IR *ir = terminator(bb);
+        BB *to = ir->bb1;
+        if (ir->ty != IR_JMP || to == bb || to == BBVecGet(&fn->bbs, 0) || to->Pred.len != 1) {
+            return merged;
+        }
+
+        for (int i = 0; i < to->Params.len; i++) {
+            subst[IntVecGet(&to->Params, i)] = IRBBArgs(fn, ir)[i];
+        }
+        IRVecPop(&bb->IRs);
+        for (int i = 0; i < to->IRs.len; i++) IRVecPush(&bb->IRs, IRVecData(&to->IRs)[i]);
+        to->IRs.len = 0;
+        to->Params.len = 0;
+        // to is unreachable now; keep it well formed until it is removed.
+        IRVecPush(&to->IRs, (IR){.ty = IR_JMP, .bb1 = to});
+        merged = 1;
+    }
+}
+
+static int resolve(int *subst, int r) {
+    while (r && subst[r]) r = subst[r];
+    return r;
+}
+
+static void substitute(Function *fn, int *subst) {
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        for (int i = 0; i < bb->IRs.len; i++) {
+            IR *ir = IRVecData(&bb->IRs) + i;
+            ir->r1 = resolve(subst, ir->r1);
+            ir->r2 = resolve(subst, ir->r2);
+            if (ir->ty == IR_CALL) {
+                for (int i = 0; i < ir->NArgs; i++) IRArgs(fn, ir)[i] = resolve(subst, IRArgs(fn, ir)[i]);
+            }
+            if (ir->ty == IR_JMP) {
+                for (int i = 0; i < ir->NBBArgs; i++) IRBBArgs(fn, ir)[i] = resolve(subst, IRBBArgs(fn, ir)[i]);
+            }
+        }
+    }
+}
+
+// Simplifies the CFG of fn.
+int SimplifyCFG(Function *fn) {
+    int changed = 0;
+    for (;;) {
+        Require(fn, ANALYSIS_CFG);
+        changed |= RemoveUnreachable(fn);
+
+        int redirected = 0;
+        DefUse *du = NewDefUse(fn);
+        for (int i = 0; i < fn->bbs.len; i++) redirected |= redirect(fn, du, BBVecGet(&fn->bbs, i));
+        FreeDefUse(du);
+        if (redirected) {
+            Invalidate(fn, ANALYSIS_CFG);
+            changed = 1;
+            continue;
+        }
+
+        // Merging keeps the number of predecessors of the other blocks.
+        int merged = 0;
+        int *subst = MemCalloc(MEM_OTHER, fn->NRegs + 1, sizeof(int));
+        for (int i = 0; i < fn->bbs.len; i++) merged |= merge(fn, BBVecGet(&fn->bbs, i), subst);
+        if (merged) substitute(fn, subst);
+        MemFree(subst);
+        if (!merged) return changed;
+        Invalidate(fn, ANALYSIS_CFG);
+        changed = 1;
+    }
+}
@@ -0,0 +1,8 @@
+#ifndef SIMPLIFYCFG_H
+#define SIMPLIFYCFG_H
+
+#include "ir.h"
+
+int SimplifyCFG(Function *fn);
+
+#endif
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include "stats.h"
+#include "ir.h"
+#include "mem.h"
+
+int StatsEnabled;
+
+// Functions in the order their statistics were first recorded.
+static Vector *funcs;
+
+Stats *GetStats(Function *fn) {
+    if (!fn->Stats) {
+        fn->Stats = MemCalloc(MEM_OTHER, 1, sizeof(Stats));
+        fn->Stats->Stages = NewVector();
+        if (!funcs) funcs = NewVector();
+        VectorPush(funcs, fn);
+    }
+    return fn->Stats;
+}
+
+// Records the size of fn after the given stage.
+void StatsStageEnd(Function *fn, char *stage) {
+    if (!StatsEnabled) return;
+
+    StatsStage *s = MemCalloc(MEM_OTHER, 1, sizeof(StatsStage));
+    s->Name = stage;
+    s->Blocks = fn->bbs.len;
+    for (int i = 0; i < fn->bbs.len; i++) {
+        BB *bb = BBVecGet(&fn->bbs, i);
+        for (int i = 0; i < bb->IRs.len; i++) {
+            if (IRVecData(&bb->IRs)[i].ty != IR_NOP) s->Insts++;
+        }
+    }
+    VectorPush(GetStats(fn)->Stages, s);
+}
+
+static void printCounters(Stats *st) {
+    fprintf(stderr, "\"lines\": %d, \"ast_nodes\": %d, \"vregs\": %d, \"spilled\": %d, "
+            "\"nops\": %d, \"frame_size\": %d, \"asm_insts\": %d",
+            st->Lines, st->ASTNodes, st->Regs, st->Spilled, st->Nops, st->FrameSize, st->AsmInsts);
+}
+
+static void printStages(Vector *stages) {
+    fprintf(stderr, "\"stages\": [");
+    for (int i = 0; i < VectorSize(stages); i++) {
+        StatsStage *s = VectorGet(stages, i);
+        fprintf(stderr, "%s{\"name\": \"%s\", \"blocks\": %d, \"insts\": %d}",
+                i ? ", " : "", s->Name, s->Blocks, s->Insts);
+    }
+    fprintf(stderr, "]");
+}
+
+void PrintStats() {
+    if (!funcs) funcs = NewVector();
+    Stats total = {0};
+    total.Stages = NewVector();
+
+    fprintf(stderr, "{\n  \"functions\": [");
+    for (int i = 0; i < VectorSize(funcs); i++) {
+        Function *fn = VectorGet(funcs, i);
+        Stats *st = fn->Stats;
+        fprintf(stderr, "%s\n    {\"name\": \"%s\", ", i ? "," : "", fn->Name);
+        printCounters(st);
+        fprintf(stderr, ", ");
+        printStages(st->Stages);
+        fprintf(stderr, "}");
+
+        total.Lines += st->Lines;
+        total.ASTNodes += st->ASTNodes;
+        total.Regs += st->Regs;
+        total.Spilled += st->Spilled;
+        total.Nops += st->Nops;
+        total.FrameSize += st->FrameSize;
+        total.AsmInsts += st->AsmInsts;
+
+        // Every function goes through the same stages, so they are
+        // summed position by position.
+        for (int i = 0; i < VectorSize(st->Stages); i++) {
+            StatsStage *s = VectorGet(st->Stages, i);
+            if (i == VectorSize(total.Stages)) {
+                StatsStage *t = MemCalloc(MEM_OTHER, 1, sizeof(StatsStage));
+                t->Name = s->Name;
+                VectorPush(total.Stages, t);
+            }
+            StatsStage *t = VectorGet(total.Stages, i);
+            t->Blocks += s->Blocks;
+            t->Insts += s->Insts;
+        }
+    }
+    fprintf(stderr, "\n  ],\n  \"total\": {\"functions\": %d, ", VectorSize(funcs));
+    printCounters(&total);
+    fprintf(stderr, ", ");
+    printStages(total.Stages);
+    fprintf(stderr, "}\n}\n");
+}
@@ -0,0 +1,35 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "ast.h"
+
+// Per-function compilation statistics for -stats=json.
+//
+// Every phase fills in what it knows about a function; the report is
+// printed to stderr as one JSON object when the compiler exits.
+
+// The size of a function after some stage of the pipeline.
+typedef struct StatsStage {
+    char *Name;
+    int Blocks;
+    int Insts; // IR instructions other than nop
+} StatsStage;
+
+struct Stats {
+    int Lines; // source lines, from the declarator to the closing brace
+    int ASTNodes;
+    Vector *Stages;
+    int Regs; // virtual registers
+    int Spilled;
+    int Nops; // moves turned into nops after register allocation
+    int FrameSize;
+    int AsmInsts;
+};
+
+extern int StatsEnabled;
+
+Stats *GetStats(Function *fn);
+void StatsStageEnd(Function *fn, char *stage);
+void PrintStats();
+
+#endif
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Regression tests. Each program in test/ is compiled with xacc at
+# every -O level, linked with CC and run; its output must match
+# test/<name>.out. The -O0 IR of each program, dumped as text and as a
+# binary module and read back, must compile to the same assembly.
+# Prints the failures and exits with 1 if any.
+xacc=${XACC:-./xacc}
+cc=${CC:-cc}
+dir=$(dirname "$0")/test
+tmp=${TMPDIR:-/tmp}/xacc-test-$$
+trap 'rm -f "$tmp.s" "$tmp.bin" "$tmp.out" "$tmp.err" "$tmp.ir" "$tmp.irbin" "$tmp.rt.s"' EXIT
+
+status=0
+for src in "$dir"/*.c; do
+    name=$(basename "$src" .c)
+    for level in -O0 -O1 -O2; do
+        if ! $xacc $level "$src" > "$tmp.s" 2> "$tmp.err" ||
+           ! $cc -no-pie -o "$tmp.bin" "$tmp.s" 2>> "$tmp.err"; then
+            echo "$name $level: failed to compile" >&2
+            cat "$tmp.err" >&2
+            status=1
+            continue
+        fi
+        "$tmp.bin" > "$tmp.out"
+        if ! cmp -s "$tmp.out" "$dir/$name.out"; then
+            echo "$name $level: wrong output" >&2
+            status=1
+        fi
+    done
+
+    $xacc -O0 "$src" > "$tmp.s" 2> "$tmp.err"
+    for lang in ir irbin; do
+        if ! $xacc -O0 -emit-$lang "$src" > "$tmp.$lang" 2>> "$tmp.err" ||
+           ! $xacc -x $lang "$tmp.$lang" > "$tmp.rt.s" 2>> "$tmp.err" ||
+           ! cmp -s "$tmp.s" "$tmp.rt.s"; then
+            echo "$name -x $lang: assembly differs after a round trip" >&2
+            cat "$tmp.err" >&2
+            status=1
+        fi
+    done
+done
+[ $status = 0 ] && echo "all tests passed"
+exit $status
@@ -0,0 +1,51 @@
+int printf();
+int g;
+// Stores through pointers and calls must clobber the values loadelim
+// keeps for what they may write.
+
+// p is &x or &y depending on the loop, so a store through it may write x.
+int throughLoop(int n) {
+    int x;
+    int y;
+    int *p;
+    int a;
+    int i;
+    y = 0;
+    p = &y;
+    for (i = 0; i < n; i++) p = &x;
+    x = 10;
+    a = x;
+    *p = 20;
+    return a + x + y;
+}
+
+// q may point to g.
+int throughPointer(int *q) {
+    int a;
+    g = 1;
+    a = g;
+    *q = 5;
+    return a + g;
+}
+
+int set(int *p) {
+    *p = 7;
+    return 0;
+}
+
+// set is given the address of x, so it may write x.
+int throughCall() {
+    int x;
+    int a;
+    x = 1;
+    a = x;
+    set(&x);
+    return a + x;
+}
+
+int main() {
+    printf("%d %d\n", throughLoop(0), throughLoop(3));
+    printf("%d\n", throughPointer(&g));
+    printf("%d\n", throughCall());
+    return 0;
+}
@@ -0,0 +1,58 @@
+int printf();
+int *gp;
+// Stores dse must keep. The locals are arrays so that mem2reg leaves
+// them in memory.
+
+// The store in the body is only read after the back edge.
+int backEdge(int n) {
+    int a[1];
+    int s;
+    int i;
+    s = 0;
+    a[0] = 1;
+    for (i = 0; i < n; i++) {
+        s = s + a[0];
+        a[0] = i + 2;
+    }
+    return s;
+}
+
+// The address of a is stored to memory and read back through it.
+int escapesToMemory() {
+    int a[1];
+    gp = a;
+    a[0] = 3;
+    return *gp;
+}
+
+int get(int *p) {
+    return *p;
+}
+
+// The address of a is passed to a call.
+int escapesToCall() {
+    int a[1];
+    a[0] = 4;
+    return get(a);
+}
+
+// a[0] = 5 writes only part of a, so a[1] = 2 is still read.
+int partial(int n) {
+    int a[2];
+    int s;
+    int i;
+    s = 0;
+    a[0] = 1;
+    a[1] = 2;
+    a[0] = 5;
+    for (i = 0; i < n; i++) s = s + i;
+    return a[0] * 10 + a[1] + s;
+}
+
+int main() {
+    printf("%d\n", backEdge(3));
+    printf("%d\n", escapesToMemory());
+    printf("%d\n", escapesToCall());
+    printf("%d\n", partial(2));
+    return 0;
+}
@@ -0,0 +1,34 @@
+int printf();
+// Instructions that may fault must not be hoisted out of loops to
+// where they run even if their block doesn't.
+
+// *(p + k) is invariant but only read when p is not null.
+int load(int *p, int k, int n) {
+    int s;
+    int i;
+    s = 0;
+    for (i = 0; i < n; i++) {
+        if (p) s = s + *(p + k);
+    }
+    return s;
+}
+
+// k / d and k % d are invariant but only computed when d is not 0.
+int divide(int k, int d, int n) {
+    int s;
+    int i;
+    s = 0;
+    for (i = 0; i < n; i++) {
+        if (d) s = s + k / d + k % d;
+    }
+    return s;
+}
+
+int main() {
+    int a[2];
+    a[0] = 1;
+    a[1] = 2;
+    printf("%d %d\n", load(a, 1, 3), load(0, 1, 3));
+    printf("%d %d\n", divide(7, 2, 3), divide(7, 0, 3));
+    return 0;
+}
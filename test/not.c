@@ -0,0 +1,7 @@
+int printf();
+// ! of a constant is folded by the parser and must not also be
+// complemented.
+int main() {
+    printf("%d %d %d\n", !5, !0, !!3);
+    return 0;
+}
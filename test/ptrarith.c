@@ -0,0 +1,29 @@
+int printf();
+int a[8];
+char s[8];
+// Pointer arithmetic is scaled by the size of the element pointed to.
+int main() {
+    int i;
+    for (i = 0; i < 8; i++) a[i] = i * 10;
+    for (i = 0; i < 8; i++) s[i] = i + 65;
+    int *p = a;
+    int *q = a + 5;
+    printf("%d %d\n", *(p + 2), *(q - 1));
+    p++;
+    printf("%d\n", *p);
+    ++p;
+    printf("%d\n", *p);
+    p--;
+    printf("%d\n", *p);
+    --p;
+    printf("%d\n", *p);
+    p += 3;
+    printf("%d\n", *p);
+    p -= 2;
+    printf("%d\n", *p);
+    printf("%d %d\n", q - p, p - q);
+    char *c = s;
+    c += 3;
+    printf("%d %d\n", *c, c - s);
+    return 0;
+}
@@ -0,0 +1,19 @@
+int printf();
+int g = -7;
+int a[4];
+// ints read back from memory and negative immediates keep their sign.
+int main() {
+    int x = -5;
+    int *p = &x;
+    if (*p < 0) printf("negative\n");
+    a[0] = -1;
+    a[1] = 3;
+    int j = 1;
+    while (j >= 0 && a[j] != -1) j--;
+    printf("%d\n", j);
+    printf("%d %d\n", g / 2, g % 3);
+    int y = -2147483647;
+    y = y - 1;
+    printf("%d\n", y < 0);
+    return 0;
+}
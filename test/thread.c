@@ -0,0 +1,24 @@
+int printf();
+int g1 = 1;
+int ga[8];
+// A jump passing a constant to a block that branches on one parameter
+// but also gets another one must not be threaded past the block.
+int f(int x, int j) {
+    int y = 5;
+    int i;
+    if (g1) {
+        do {
+            ga[(x ^ y) & 7] = ((y && ga[6]) ^ !x) & 65535;
+            for (i = 0; i < 3; i++) y = -y & 65535;
+            j--;
+        } while (j > 0);
+    }
+    return y + ga[0] + ga[1] + ga[2] + ga[3] + ga[4] + ga[5] + ga[7];
+}
+int main() {
+    ga[6] = 1;
+    printf("%d\n", f(0, 4));
+    printf("%d\n", f(2, 3));
+    printf("%d\n", f(1, 2));
+    return 0;
+}
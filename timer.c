@@ -0,0 +1,135 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "timer.h"
+#include "util.h"
+
+static char *phaseNames[] = {
+    "lex", "parse", "irgen", "opt", "analyze", "allocate", "genx86",
+};
+
+typedef struct Frame {
+    Phase phase;
+    double wall, cpu;           // when the phase began
+    double childWall, childCpu; // time spent in nested phases
+} Frame;
+
+int TimeReport;
+static int enabled;
+static FILE *traceFile;
+static int nEvents;
+static double origin;
+
+// Phases nest no deeper than the compiler's own calls to TimerBegin.
+#define MAX_DEPTH 16
+
+static Frame stack[MAX_DEPTH];
+static int depth;
+static double wallTotal[NUM_PHASES], cpuTotal[NUM_PHASES];
+
+static double now(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void enable() {
+    if (!enabled) origin = now(CLOCK_MONOTONIC);
+    enabled = 1;
+}
+
+void StartTrace(char *path) {
+    traceFile = fopen(path, "w");
+    if (traceFile == NULL) {
+        fprintf(stderr, "Failed to open file '%s' for writing\n", path);
+        exit(1);
+    }
+    fprintf(traceFile, "{\"traceEvents\":[\n");
+    enable();
+}
+
+// Writes s to the trace as a JSON string.
+static void writeString(char *s) {
+    fputc('"', traceFile);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(traceFile, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(traceFile, "\\u%04x", c);
+        } else {
+            fputc(c, traceFile);
+        }
+    }
+    fputc('"', traceFile);
+}
+
+void TimerBegin(Phase phase) {
+    if (!enabled && TimeReport) enable();
+    if (!enabled) return;
+
+    if (depth == MAX_DEPTH) {
+        fprintf(stderr, "Timed phases nested deeper than %d\n", MAX_DEPTH);
+        exit(1);
+    }
+    Frame *f = &stack[depth++];
+    f->phase = phase;
+    f->wall = now(CLOCK_MONOTONIC);
+    f->cpu = now(CLOCK_PROCESS_CPUTIME_ID);
+    f->childWall = f->childCpu = 0;
+}
+
+void TimerEnd(char *fnName) {
+    if (!enabled) return;
+
+    if (depth == 0) {
+        fprintf(stderr, "TimerEnd without TimerBegin\n");
+        exit(1);
+    }
+    Frame *f = &stack[--depth];
+    double wall = now(CLOCK_MONOTONIC) - f->wall;
+    double cpu = now(CLOCK_PROCESS_CPUTIME_ID) - f->cpu;
+    wallTotal[f->phase] += wall - f->childWall;
+    cpuTotal[f->phase] += cpu - f->childCpu;
+    if (depth > 0) {
+        stack[depth - 1].childWall += wall;
+        stack[depth - 1].childCpu += cpu;
+    }
+
+    if (!traceFile || f->phase == PHASE_LEX) return;
+    fprintf(traceFile, "%s{\"name\":\"%s\",\"cat\":\"xacc\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+            "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"function\":",
+            nEvents++ ? ",\n" : "", phaseNames[f->phase],
+            (f->wall - origin) * 1e6, wall * 1e6);
+    writeString(fnName ? fnName : "");
+    fprintf(traceFile, "}}");
+}
+
+static void printReport() {
+    double wall = 0, cpu = 0;
+    for (int i = 0; i < NUM_PHASES; i++) {
+        wall += wallTotal[i];
+        cpu += cpuTotal[i];
+    }
+
+    fprintf(stderr, "Execution times (seconds)\n");
+    fprintf(stderr, "  %-10s %18s %18s\n", "phase", "wall", "cpu");
+    for (int i = 0; i < NUM_PHASES; i++) {
+        fprintf(stderr, "  %-10s %10.6f (%3.0f%%) %10.6f (%3.0f%%)\n", phaseNames[i],
+                wallTotal[i], wall ? wallTotal[i] / wall * 100 : 0,
+                cpuTotal[i], cpu ? cpuTotal[i] / cpu * 100 : 0);
+    }
+    fprintf(stderr, "  %-10s %10.6f        %10.6f\n", "total", wall, cpu);
+}
+
+// Prints the report and closes the trace. Called once, after the
+// last phase has ended.
+void FinishTimers() {
+    if (TimeReport) printReport();
+    if (traceFile) {
+        fprintf(traceFile, "\n]}\n");
+        fclose(traceFile);
+        traceFile = NULL;
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+// Compile time accounting for -ftime-report and -ftrace.
+//
+// Phases nest: time spent in a phase started while another one is
+// running (lexing inside parsing, say) is charged to the inner phase
+// only. Every phase except lexing is also recorded as a span in the
+// trace, tagged with the function it worked on.
+
+typedef enum Phase {
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_IRGEN,
+    PHASE_OPT,
+    PHASE_ANALYZE,
+    PHASE_ALLOCATE,
+    PHASE_GENX86,
+    NUM_PHASES,
+} Phase;
+
+extern int TimeReport;
+
+void StartTrace(char *path);
+void TimerBegin(Phase phase);
+void TimerEnd(char *fnName);
+void FinishTimers();
+
+#endif
@@ -2,9 +2,10 @@
 #include <string.h>
 #include <assert.h>
 #include "token.h"
+#include "mem.h"
 
 Token *NewToken(int line, TokenType type, char *literal) {
-    Token *token = calloc(1, sizeof(Token));
+    Token *token = MemCalloc(MEM_TOKEN, 1, sizeof(Token));
     token->Line = line;
     token->Type = type;
     token->Literal = literal;
@@ -13,7 +14,7 @@ Token *NewToken(int line, TokenType type, char *literal) {
 }
 
 Token *NewTokenWithOrigin(int line, TokenType type, char *literal, char *origin) {
-    Token *token = calloc(1, sizeof(Token));
+    Token *token = MemCalloc(MEM_TOKEN, 1, sizeof(Token));
     token->Line = line;
     token->Type = type;
     token->Literal = literal;
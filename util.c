@@ -4,10 +4,12 @@
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 #include "util.h"
+#include "mem.h"
 Vector *NewVector() {
-    Vector *v = calloc(1, sizeof(Vector));
-    v->data = malloc(sizeof(void *) * 16);
+    Vector *v = MemCalloc(MEM_VECTOR, 1, sizeof(Vector));
+    v->data = MemMalloc(MEM_VECTOR, sizeof(void *) * 16);
     v->capacity = 16;
     v->len = 0;
     return v;
@@ -20,15 +22,14 @@ void VectorPush(Vector *v, void *elem) {
         } else {
             v->capacity *= 1.25;
         }
-        v->data = realloc(v->data, sizeof(void *) * v->capacity);
+        v->data = MemRealloc(v->data, sizeof(void *) * v->capacity);
     }
     v->data[v->len++] = elem;
 }
 
+// Integers are stored in the pointer slots themselves.
 void VectorPushInt(Vector *v, int val) {
-    int *tmp = malloc(sizeof(int));
-    *tmp = val;
-    VectorPush(v, tmp);
+    VectorPush(v, (void *)(intptr_t)val);
 }
 
 void *VectorPop(Vector *v) {
@@ -43,7 +44,7 @@ void *VectorGet(Vector *v, int i) {
 
 int VectorGetInt(Vector *v, int i) {
     assert(i < v->len);
-    return *((int *)(v->data[i]));
+    return (intptr_t)v->data[i];
 }
 
 void VectorSet(Vector *v, int i, void *elem) {
@@ -53,13 +54,13 @@ void VectorSet(Vector *v, int i, void *elem) {
 
 void VectorReplace(Vector *v, int i, void *elem) {
     assert(i < v->len);
-    free(v->data[i]);
+    MemFree(v->data[i]);
     v->data[i] = elem;
 }
 
 void VectorSetInt(Vector *v, int i, int val) {
     assert(i < v->len);
-    *(int *)(v->data[i]) = val; 
+    v->data[i] = (void *)(intptr_t)val;
 }
 
 void *VectorLast(Vector *v) {
@@ -85,7 +86,7 @@ int VectorSize(Vector *v) {
 }
 
 Map *NewMap(void) {
-    Map *map = calloc(1, sizeof(Map));
+    Map *map = MemCalloc(MEM_MAP, 1, sizeof(Map));
     map->keys = NewVector();
     map->vals = NewVector();
     return map;
@@ -168,8 +169,8 @@ Vector *MapVals(Map *map) {
 }
 
 StringBuilder *NewStringBuilder() {
-    StringBuilder *sb = malloc(sizeof(StringBuilder));
-    sb->data = malloc(8);
+    StringBuilder *sb = MemMalloc(MEM_STRING, sizeof(StringBuilder));
+    sb->data = MemMalloc(MEM_STRING, 8);
     sb->capacity = 8;
     sb->len = 0;
     return sb;
@@ -187,7 +188,7 @@ void stringBuilderGrow(StringBuilder *sb, int len) {
             sb->capacity *= 1.25;
         }
     }
-    sb->data = realloc(sb->data, sb->capacity);
+    sb->data = MemRealloc(sb->data, sb->capacity);
 }
 
 void StringBuilderAdd(StringBuilder *sb, char c) {
@@ -210,6 +211,126 @@ char *StringBuilderToString(StringBuilder *sb) {
     return sb->data;
 }
 
+#define WORD_BITS (int)(sizeof(unsigned long) * 8)
+
+BitSet *NewBitSet() {
+    return MemCalloc(MEM_BITSET, 1, sizeof(BitSet));
+}
+
+static void bitSetGrow(BitSet *s, int len) {
+    if (len <= s->capacity) return;
+    while (s->capacity < len) s->capacity = s->capacity ? s->capacity * 2 : 4;
+    s->keys = s->keys ? MemRealloc(s->keys, sizeof(int) * s->capacity)
+                      : MemMalloc(MEM_BITSET, sizeof(int) * s->capacity);
+    s->words = s->words ? MemRealloc(s->words, sizeof(unsigned long) * s->capacity)
+                        : MemMalloc(MEM_BITSET, sizeof(unsigned long) * s->capacity);
+}
+
+// Returns the position of the first word of s at or after key.
+static int bitSetFind(BitSet *s, int key) {
+    int lo = 0, hi = s->len;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (s->keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void BitSetAdd(BitSet *s, int i) {
+    int key = i / WORD_BITS;
+    int k = bitSetFind(s, key);
+    if (k == s->len || s->keys[k] != key) {
+        bitSetGrow(s, s->len + 1);
+        memmove(s->keys + k + 1, s->keys + k, sizeof(int) * (s->len - k));
+        memmove(s->words + k + 1, s->words + k, sizeof(unsigned long) * (s->len - k));
+        s->keys[k] = key;
+        s->words[k] = 0;
+        s->len++;
+    }
+    s->words[k] |= 1UL << (i % WORD_BITS);
+}
+
+int BitSetContain(BitSet *s, int i) {
+    int key = i / WORD_BITS;
+    int k = bitSetFind(s, key);
+    return k < s->len && s->keys[k] == key && ((s->words[k] >> (i % WORD_BITS)) & 1);
+}
+
+int BitSetNext(BitSet *s, int i) {
+    int k = bitSetFind(s, i / WORD_BITS);
+    if (k == s->len) return -1;
+
+    unsigned long bits = s->words[k];
+    if (s->keys[k] == i / WORD_BITS) bits &= ~0UL << (i % WORD_BITS);
+    while (!bits) {
+        if (++k == s->len) return -1;
+        bits = s->words[k];
+    }
+    return s->keys[k] * WORD_BITS + __builtin_ctzl(bits);
+}
+
+// Ors the n words at the given positions into s.
+static int bitSetMerge(BitSet *s, int *keys, unsigned long *words, int n) {
+    // Count the positions s doesn't have yet.
+    int extra = 0;
+    for (int i = 0, j = 0; i < n; i++) {
+        while (j < s->len && s->keys[j] < keys[i]) j++;
+        if (words[i] && (j == s->len || s->keys[j] != keys[i])) extra++;
+    }
+
+    // Merge from the back, so that s can be updated in place.
+    bitSetGrow(s, s->len + extra);
+    int changed = extra > 0;
+    int i = n - 1, j = s->len - 1, k = s->len + extra - 1;
+    while (i >= 0) {
+        if (!words[i]) {
+            i--;
+        } else if (j >= 0 && s->keys[j] > keys[i]) {
+            s->keys[k] = s->keys[j];
+            s->words[k--] = s->words[j--];
+        } else if (j >= 0 && s->keys[j] == keys[i]) {
+            unsigned long w = s->words[j] | words[i--];
+            changed |= w != s->words[j];
+            s->keys[k] = s->keys[j];
+            s->words[k--] = w;
+            j--;
+        } else {
+            s->keys[k] = keys[i];
+            s->words[k--] = words[i--];
+        }
+    }
+    s->len += extra;
+    return changed;
+}
+
+int BitSetUnion(BitSet *s, BitSet *t) {
+    return bitSetMerge(s, t->keys, t->words, t->len);
+}
+
+int BitSetUnionDiff(BitSet *s, BitSet *t, BitSet *u) {
+    static BitSet tmp;
+    bitSetGrow(&tmp, t->len);
+    for (int i = 0, j = 0; i < t->len; i++) {
+        while (j < u->len && u->keys[j] < t->keys[i]) j++;
+        tmp.keys[i] = t->keys[i];
+        tmp.words[i] = t->words[i];
+        if (j < u->len && u->keys[j] == t->keys[i]) tmp.words[i] &= ~u->words[j];
+    }
+    return bitSetMerge(s, tmp.keys, tmp.words, t->len);
+}
+
+void BitSetClear(BitSet *s) {
+    s->len = 0;
+}
+
+void BitSetFree(BitSet *s) {
+    if (!s) return;
+    MemFree(s->keys);
+    MemFree(s->words);
+    MemFree(s);
+}
+
 char *Format(char *fmt, ...) {
     char buf[2048];
     va_list ap;
@@ -220,7 +341,7 @@ char *Format(char *fmt, ...) {
 }
 
 char *StringClone(char *s, int len) {
-    char *tmp = calloc(1, len + 1);
+    char *tmp = MemCalloc(MEM_STRING, 1, len + 1);
     memcpy(tmp, s, len);
     tmp[len] = '\0';
     return tmp;
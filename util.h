@@ -9,6 +9,9 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <assert.h>
+#include "mem.h"
+
 typedef struct Vector {
     void **data;
     int capacity;
@@ -29,6 +32,94 @@ int VectorContain(Vector *v, void *elem);
 int VectorUnion(Vector *v, void *elem);
 int VectorSize(Vector *v);
 
+// Typed vectors.
+//
+// DEFINE_VEC(Name, T) defines a vector of T that keeps its first
+// VEC_INLINE elements inside the vector itself, so short vectors need
+// no allocation. A zeroed Name is an empty vector; vectors are meant
+// to be embedded by value in the structures that own them.
+// DEFINE_STRUCT_VEC is the same for element types that cannot be
+// compared with ==, without Contain and Union, and charges the heap
+// storage to the given MemOwner.
+#define VEC_INLINE 4
+
+#define DEFINE_STRUCT_VEC(Name, T, Owner)                                   \
+typedef struct Name {                                                       \
+    int len;                                                                \
+    int capacity; /* 0 while the elements are inline */                     \
+    union {                                                                 \
+        T buf[VEC_INLINE];                                                  \
+        T *heap;                                                            \
+    };                                                                      \
+} Name;                                                                     \
+                                                                            \
+static inline T *Name##Data(Name *v) {                                      \
+    return v->capacity ? v->heap : v->buf;                                  \
+}                                                                           \
+                                                                            \
+static inline void Name##Reserve(Name *v, int n) {                         \
+    if (n <= (v->capacity ? v->capacity : VEC_INLINE)) return;              \
+    int capacity = v->capacity ? v->capacity : VEC_INLINE;                  \
+    while (capacity < n) capacity *= 2;                                     \
+    if (v->capacity) {                                                      \
+        v->heap = MemRealloc(v->heap, sizeof(T) * capacity);                \
+    } else {                                                                \
+        T *heap = MemMalloc(Owner, sizeof(T) * capacity);                   \
+        for (int i = 0; i < v->len; i++) heap[i] = v->buf[i];               \
+        v->heap = heap;                                                     \
+    }                                                                       \
+    v->capacity = capacity;                                                 \
+}                                                                           \
+                                                                            \
+static inline void Name##Push(Name *v, T elem) {                            \
+    Name##Reserve(v, v->len + 1);                                           \
+    Name##Data(v)[v->len++] = elem;                                         \
+}                                                                           \
+                                                                            \
+static inline T Name##Pop(Name *v) {                                        \
+    assert(v->len);                                                         \
+    return Name##Data(v)[--v->len];                                         \
+}                                                                           \
+                                                                            \
+static inline T Name##Get(Name *v, int i) {                                 \
+    assert(i < v->len);                                                     \
+    return Name##Data(v)[i];                                                \
+}                                                                           \
+                                                                            \
+static inline void Name##Set(Name *v, int i, T elem) {                      \
+    assert(i < v->len);                                                     \
+    Name##Data(v)[i] = elem;                                                \
+}                                                                           \
+                                                                            \
+static inline T Name##Last(Name *v) {                                       \
+    assert(v->len);                                                         \
+    return Name##Data(v)[v->len - 1];                                       \
+}                                                                           \
+                                                                            \
+static inline void Name##Free(Name *v) {                                    \
+    if (v->capacity) MemFree(v->heap);                                      \
+    v->len = v->capacity = 0;                                               \
+}
+
+#define DEFINE_VEC(Name, T)                                                 \
+DEFINE_STRUCT_VEC(Name, T, MEM_VECTOR)                                      \
+                                                                            \
+static inline int Name##Contain(Name *v, T elem) {                          \
+    for (int i = 0; i < v->len; i++) {                                      \
+        if (Name##Data(v)[i] == elem) return 1;                             \
+    }                                                                       \
+    return 0;                                                               \
+}                                                                           \
+                                                                            \
+/* Name##Union pushes elem unless present and returns whether it was. */   \
+static inline int Name##Union(Name *v, T elem) {                            \
+    if (Name##Contain(v, elem)) return 1;                                   \
+    Name##Push(v, elem);                                                    \
+    return 0;                                                               \
+}
+
+DEFINE_VEC(IntVec, int)
+
 typedef struct Map {
     Vector *keys;
     Vector *vals;
@@ -57,6 +148,25 @@ void StringBuilderAppend(StringBuilder *sb, char *s);
 void StringBuilderAppendN(StringBuilder *sb, char *s, int len);
 char *StringBuilderToString(StringBuilder *sb);
 
+// BitSet is a sparse bit vector: only the nonzero words are stored,
+// sorted by their position, so sets cost memory in proportion to the
+// number of words they touch rather than to the largest element.
+typedef struct BitSet {
+    int len;
+    int capacity;
+    int *keys; // word positions, ascending
+    unsigned long *words;
+} BitSet;
+
+BitSet *NewBitSet();
+void BitSetAdd(BitSet *s, int i);
+int BitSetContain(BitSet *s, int i);
+int BitSetNext(BitSet *s, int i); // BitSetNext returns the first element >= i, or -1
+int BitSetUnion(BitSet *s, BitSet *t); // BitSetUnion returns whether s changed
+int BitSetUnionDiff(BitSet *s, BitSet *t, BitSet *u); // s |= t & ~u
+void BitSetClear(BitSet *s);
+void BitSetFree(BitSet *s);
+
 char *Format(char *fmt, ...);
 char *StringClone(char *s, int len);
 